@@ -0,0 +1,188 @@
+#pragma once
+#ifndef ARENA_H
+#define ARENA_H
+#include "PCH.h"
+
+//bump allocator for pipeline scratch memory, nothing is freed until the arena is rewound or reset
+class LinearArena
+{
+public:
+	struct Marker
+	{
+		size_t m_block;
+		size_t m_offset;
+	};
+
+	LinearArena(const size_t &pBlockSize = 1 << 20) : m_block_size(pBlockSize), m_curr_block(0), m_offset(0)
+	{
+
+	}
+
+	~LinearArena()
+	{
+		Release();
+	}
+
+	LinearArena(const LinearArena &) = delete;
+	LinearArena &operator=(const LinearArena &) = delete;
+
+	void *Allocate(const size_t &pSize, const size_t &pAlignment)
+	{
+		while (m_curr_block < m_blocks.size())
+		{
+			void *ptr = AllocateFromBlock(m_blocks[m_curr_block], pSize, pAlignment);
+			if (ptr != nullptr)
+			{
+				return ptr;
+			}
+
+			m_curr_block++;
+			m_offset = 0;
+		}
+
+		Block block;
+		block.m_size = max(m_block_size, pSize + pAlignment);
+		block.m_data = static_cast<unsigned char*>(::operator new(block.m_size));
+		m_blocks.emplace_back(block);
+
+		return AllocateFromBlock(m_blocks[m_curr_block], pSize, pAlignment);
+	}
+
+	template<typename T>
+	T *Allocate(const size_t &pNum)
+	{
+		return static_cast<T*>(Allocate(sizeof(T) * pNum, alignof(T)));
+	}
+
+	Marker GetMarker() const
+	{
+		Marker marker;
+		marker.m_block = m_curr_block;
+		marker.m_offset = m_offset;
+		return marker;
+	}
+
+	void Rewind(const Marker &pMarker)
+	{
+		m_curr_block = pMarker.m_block;
+		m_offset = pMarker.m_offset;
+	}
+
+	//called once per frame, a frame that needed several blocks gets a single block big enough for all of them
+	void Reset()
+	{
+		if (m_blocks.size() > 1)
+		{
+			size_t total_size = 0;
+			for (size_t i = 0; i < m_blocks.size(); i++)
+			{
+				total_size += m_blocks[i].m_size;
+			}
+
+			Release();
+
+			m_block_size = max(m_block_size, total_size);
+		}
+
+		m_curr_block = 0;
+		m_offset = 0;
+	}
+
+private:
+	struct Block
+	{
+		unsigned char *m_data;
+		size_t m_size;
+	};
+
+	void *AllocateFromBlock(const Block &pBlock, const size_t &pSize, const size_t &pAlignment)
+	{
+		uintptr_t base = reinterpret_cast<uintptr_t>(pBlock.m_data);
+		uintptr_t aligned = (base + m_offset + pAlignment - 1) & ~(static_cast<uintptr_t>(pAlignment) - 1);
+
+		if (aligned + pSize > base + pBlock.m_size)
+		{
+			return nullptr;
+		}
+
+		m_offset = aligned + pSize - base;
+		return reinterpret_cast<void*>(aligned);
+	}
+
+	void Release()
+	{
+		for (size_t i = 0; i < m_blocks.size(); i++)
+		{
+			::operator delete(m_blocks[i].m_data);
+		}
+		m_blocks.clear();
+	}
+
+	std::vector<Block> m_blocks;
+	size_t m_block_size;
+	size_t m_curr_block;
+	size_t m_offset;
+};
+
+//rewinds the arena to where it was when the scope was entered
+class ArenaScope
+{
+public:
+	ArenaScope(LinearArena &pArena) : m_arena(pArena), m_marker(pArena.GetMarker())
+	{
+
+	}
+
+	~ArenaScope()
+	{
+		m_arena.Rewind(m_marker);
+	}
+
+private:
+	LinearArena &m_arena;
+	LinearArena::Marker m_marker;
+};
+
+template<typename T>
+class ArenaAllocator
+{
+public:
+	using value_type = T;
+
+	template<typename U>
+	friend class ArenaAllocator;
+
+	ArenaAllocator(LinearArena *pArena) : m_arena(pArena) {}
+
+	template<typename U>
+	ArenaAllocator(const ArenaAllocator<U> &pOther) : m_arena(pOther.m_arena) {}
+
+	T *allocate(const size_t n)
+	{
+		return m_arena->Allocate<T>(n);
+	}
+
+	void deallocate(T *, const size_t)
+	{
+	}
+
+	template<typename U>
+	bool operator==(const ArenaAllocator<U> &rhs) const
+	{
+		return m_arena == rhs.m_arena;
+	}
+
+	template<typename U>
+	bool operator!=(const ArenaAllocator<U> &rhs) const
+	{
+		return m_arena != rhs.m_arena;
+	}
+
+private:
+	LinearArena *m_arena;
+};
+
+template<typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+#endif // !ARENA_H
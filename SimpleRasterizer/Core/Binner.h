@@ -0,0 +1,76 @@
+#pragma once
+#ifndef BINNER_H
+#define BINNER_H
+#include "PCH.h"
+#include "Rasterizer.h"
+
+//a tile covers tileSize * tileSize pixels and is aligned to the rasterizer block grid
+static constexpr int tileSize = blockSize * 4;
+
+class Binner
+{
+public:
+	Binner() : m_tile_num_x(0), m_tile_num_y(0) {};
+	~Binner() {};
+
+	void SetViewport(const Viewport &pViewport)
+	{
+		m_max_raster_pos = Vec2I(static_cast<int>(pViewport.m_width - pViewport.m_top_leftx - 1), static_cast<int>(pViewport.m_height - pViewport.m_top_lefty - 1));
+
+		m_tile_num_x = (m_max_raster_pos.x + tileSize) / tileSize;
+		m_tile_num_y = (m_max_raster_pos.y + tileSize) / tileSize;
+
+		m_bins.resize(m_tile_num_x * m_tile_num_y);
+		Clear();
+	}
+
+	void Clear()
+	{
+		for (size_t i = 0; i < m_bins.size(); i++)
+		{
+			m_bins[i].clear();
+		}
+	}
+
+	//triangles must be binned in primitive order, each bin keeps the order it was filled in
+	void Bin(const size_t &pTriangleIndex, const Vec2I &pBoxMin, const Vec2I &pBoxMax)
+	{
+		int tile_min_x = max(pBoxMin.x, 0) / tileSize;
+		int tile_min_y = max(pBoxMin.y, 0) / tileSize;
+		int tile_max_x = min(pBoxMax.x / tileSize, m_tile_num_x - 1);
+		int tile_max_y = min(pBoxMax.y / tileSize, m_tile_num_y - 1);
+
+		for (int y = tile_min_y; y <= tile_max_y; y++)
+		{
+			for (int x = tile_min_x; x <= tile_max_x; x++)
+			{
+				m_bins[y * m_tile_num_x + x].emplace_back(pTriangleIndex);
+			}
+		}
+	}
+
+	size_t GetTileNum() const
+	{
+		return m_bins.size();
+	}
+
+	const std::vector<size_t> &GetBin(const size_t &pTile) const
+	{
+		return m_bins[pTile];
+	}
+
+	void GetTileRect(const size_t &pTile, Vec2I &pMin, Vec2I &pMax) const
+	{
+		pMin.x = static_cast<int>(pTile % m_tile_num_x) * tileSize;
+		pMin.y = static_cast<int>(pTile / m_tile_num_x) * tileSize;
+		pMax.x = min(pMin.x + tileSize - 1, m_max_raster_pos.x);
+		pMax.y = min(pMin.y + tileSize - 1, m_max_raster_pos.y);
+	}
+
+private:
+	std::vector<std::vector<size_t>> m_bins;
+	int m_tile_num_x;
+	int m_tile_num_y;
+	Vec2I m_max_raster_pos;
+};
+#endif // !BINNER_H
@@ -4,6 +4,18 @@
 
 #include "PCH.h"
 
+enum INDEX_FORMAT : size_t
+{
+	R16_UINT = 0,
+	R32_UINT = 1
+};
+
+inline size_t GetIndexFormatSize(const INDEX_FORMAT &pFormat)
+{
+	static size_t format_size[2] = { sizeof(uint16_t), sizeof(uint32_t) };
+	return format_size[pFormat];
+}
+
 struct BufferDesc
 {
 	BufferDesc(const BufferDesc &pDesc) : m_num_of_element(pDesc.m_num_of_element), m_stride(pDesc.m_stride)
@@ -75,7 +87,7 @@ public:
 		std::memcpy(pData, m_data, pSize);
 	}
 
-	const void *GetElementData(size_t &pIndex) const
+	const void *GetElementData(const size_t &pIndex) const
 	{
 		return static_cast<unsigned char*>(m_data) + pIndex * m_desc.m_stride;
 	}
@@ -85,6 +97,11 @@ public:
 		return m_desc.m_num_of_element;
 	}
 
+	size_t GetStride() const
+	{
+		return m_desc.m_stride;
+	}
+
 
 	void *GetData()
 	{
@@ -0,0 +1,51 @@
+#pragma once
+#ifndef CPUFEATURE_H
+#define CPUFEATURE_H
+#include "PCH.h"
+#include <intrin.h>
+#include <immintrin.h>
+
+//instruction sets the SIMD paths are chosen from at runtime
+struct CPUFeature
+{
+	bool m_sse41;
+	bool m_avx2;
+};
+
+inline CPUFeature DetectCPUFeature()
+{
+	CPUFeature feature;
+	feature.m_sse41 = false;
+	feature.m_avx2 = false;
+
+	int info[4];
+	__cpuid(info, 0);
+	int max_id = info[0];
+
+	if (max_id < 1)
+	{
+		return feature;
+	}
+
+	__cpuid(info, 1);
+	feature.m_sse41 = (info[2] & (1 << 19)) != 0;
+
+	//avx state must also be enabled by the os
+	bool os_xsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+
+	if (max_id >= 7 && os_xsave && avx && (_xgetbv(0) & 6) == 6)
+	{
+		__cpuidex(info, 7, 0);
+		feature.m_avx2 = (info[1] & (1 << 5)) != 0;
+	}
+
+	return feature;
+}
+
+inline const CPUFeature &GetCPUFeature()
+{
+	static const CPUFeature feature = DetectCPUFeature();
+	return feature;
+}
+#endif // !CPUFEATURE_H
@@ -3,13 +3,22 @@
 #define CLIPPER_H
 
 #include "RenderMath.h"
+#include "Arena.h"
+#include <cstddef>
 
 enum class FragmentLayout
 {
 	BASE,
 	EXTENSION0,
-	EXTENSION1,
-	EXTENSION2
+	EXTENSION1
+};
+
+//front faces are clockwise on screen
+enum class CULL_MODE
+{
+	NONE,
+	FRONT,
+	BACK
 };
 
 struct Vertex
@@ -45,9 +54,89 @@ struct Fragment
 	Vec4f pack1 = Vec4f(0.0f);
 };
 
-struct Triangle
+inline float *FragmentData(Fragment &pFragment)
+{
+	return reinterpret_cast<float*>(&pFragment);
+}
+
+inline const float *FragmentData(const Fragment &pFragment)
+{
+	return reinterpret_cast<const float*>(&pFragment);
+}
+
+//an attribute a shader passes from the vertex to the fragment stage, Offset and Size count floats from the start of Fragment
+template<size_t Offset, size_t Size>
+struct Varying
+{
+	static constexpr size_t offset = Offset;
+	static constexpr size_t size = Size;
+};
+
+using NormalVarying = Varying<offsetof(Fragment, m_normal) / sizeof(float), 3>;
+using UVVarying = Varying<offsetof(Fragment, m_uv) / sizeof(float), 2>;
+using Pack0Varying = Varying<offsetof(Fragment, pack0) / sizeof(float), 4>;
+using Pack1Varying = Varying<offsetof(Fragment, pack1) / sizeof(float), 4>;
+
+//the varyings a pipeline declares, clipping and interpolation move exactly these floats besides the position
+template<typename... Attributes>
+struct Varyings
+{
+	static constexpr size_t count = sizeof...(Attributes);
+};
+
+using UVVaryings = Varyings<UVVarying>;
+using BaseVaryings = Varyings<NormalVarying, UVVarying>;
+using Extension0Varyings = Varyings<NormalVarying, UVVarying, Pack0Varying>;
+using Extension1Varyings = Varyings<NormalVarying, UVVarying, Pack0Varying, Pack1Varying>;
+
+static constexpr size_t maxVaryingNum = 8;
+
+//varyings declared at runtime, m_count attributes of m_size[i] floats starting m_offset[i] floats into Fragment
+struct VaryingLayout
+{
+	size_t m_count;
+	size_t m_offset[maxVaryingNum];
+	size_t m_size[maxVaryingNum];
+};
+
+//every attribute has to lie in Fragment after m_pos
+inline bool IsValidVaryingLayout(const VaryingLayout &pLayout)
+{
+	if (pLayout.m_count > maxVaryingNum)
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < pLayout.m_count; i++)
+	{
+		if (pLayout.m_offset[i] < NormalVarying::offset || pLayout.m_offset[i] + pLayout.m_size[i] > sizeof(Fragment) / sizeof(float))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+//the runtime form of a compile-time varyings list
+template<typename... Attributes>
+inline VaryingLayout GetVaryingLayout(const Varyings<Attributes...>&)
+{
+	static_assert(sizeof...(Attributes) <= maxVaryingNum, "too many varyings");
+
+	VaryingLayout layout;
+	layout.m_count = 0;
+
+	int expand[] = { 0, (layout.m_offset[layout.m_count] = Attributes::offset, layout.m_size[layout.m_count++] = Attributes::size, 0)... };
+	(void)expand;
+
+	return layout;
+}
+
+//triangle that refers to its vertices by their index in the shaded vertex array
+struct IndexedTriangle
 {
-	Fragment m_vertex[3];
+	size_t m_vertex[3];
 };
 
 struct Viewport
@@ -59,46 +148,178 @@ struct Viewport
 };
 
 
-static const std::bitset<6> Inside("0");
+//the guard band reaches this many times the viewport half size past the center, the raster setup
+//keeps edge values of vertices inside it in range (see maxViewportSize)
+static constexpr float guardBandScale = 4.0f;
+
+//clip outcode bits, bit i is set when the vertex is outside plane i
+static constexpr uint8_t clipLeft = 1 << 0;
+static constexpr uint8_t clipRight = 1 << 1;
+static constexpr uint8_t clipBottom = 1 << 2;
+static constexpr uint8_t clipTop = 1 << 3;
+static constexpr uint8_t clipNear = 1 << 4;
+static constexpr uint8_t clipFar = 1 << 5;
+static constexpr uint8_t clipSides = clipLeft | clipRight | clipBottom | clipTop;
+static constexpr uint8_t clipPlanes = clipSides | clipNear | clipFar;
+//outside the guard band on any side
+static constexpr uint8_t clipGuardBand = 1 << 6;
+
+//pScale moves the side planes out to x, y = +-pScale * w, near and far stay where they are
+inline uint8_t ComputeClipCode(const Vec4f &pVertex, const float &pScale = 1.0f)
+{
+	uint8_t clip_code = 0;
+	clip_code |= pVertex.x < -pScale * pVertex.w ? clipLeft : 0;
+	clip_code |= pVertex.x > pScale * pVertex.w ? clipRight : 0;
+	clip_code |= pVertex.y < -pScale * pVertex.w ? clipBottom : 0;
+	clip_code |= pVertex.y > pScale * pVertex.w ? clipTop : 0;
+	clip_code |= pVertex.z < 0 ? clipNear : 0;
+	clip_code |= pVertex.z > pVertex.w ? clipFar : 0;
+	return clip_code;
+}
 
-static const std::bitset<6> Left("1");
-static const std::bitset<6> Right("10");
+//outcode of a shaded vertex against the viewport planes plus the guard band bit, computed once in the vertex stage
+inline uint8_t ComputeVertexClipCode(const Vec4f &pVertex)
+{
+	uint8_t clip_code = ComputeClipCode(pVertex);
+
+	if ((clip_code & clipSides) && (ComputeClipCode(pVertex, guardBandScale) & clipSides))
+	{
+		clip_code |= clipGuardBand;
+	}
+
+	return clip_code;
+}
+
+//ComputeVertexClipCode of 8 positions at once, the outcode bits of 4 lanes are built in one register and packed to bytes
+inline void ComputeVertexClipCodes(const Vec4f8 &pVertex, uint8_t *pClipCodes)
+{
+	__m128i clip_code[2];
+
+	for (int half = 0; half < 2; half++)
+	{
+		const __m128 &x = pVertex.x.m_value[half];
+		const __m128 &y = pVertex.y.m_value[half];
+		const __m128 &z = pVertex.z.m_value[half];
+		const __m128 &w = pVertex.w.m_value[half];
+
+		__m128 neg_w = _mm_mul_ps(w, _mm_set1_ps(-1.0f));
+		__m128 guard_w = _mm_mul_ps(w, _mm_set1_ps(guardBandScale));
+		__m128 neg_guard_w = _mm_mul_ps(w, _mm_set1_ps(-guardBandScale));
+
+		__m128i code = _mm_and_si128(_mm_castps_si128(_mm_cmplt_ps(x, neg_w)), _mm_set1_epi32(clipLeft));
+		code = _mm_or_si128(code, _mm_and_si128(_mm_castps_si128(_mm_cmpgt_ps(x, w)), _mm_set1_epi32(clipRight)));
+		code = _mm_or_si128(code, _mm_and_si128(_mm_castps_si128(_mm_cmplt_ps(y, neg_w)), _mm_set1_epi32(clipBottom)));
+		code = _mm_or_si128(code, _mm_and_si128(_mm_castps_si128(_mm_cmpgt_ps(y, w)), _mm_set1_epi32(clipTop)));
+		code = _mm_or_si128(code, _mm_and_si128(_mm_castps_si128(_mm_cmplt_ps(z, _mm_setzero_ps())), _mm_set1_epi32(clipNear)));
+		code = _mm_or_si128(code, _mm_and_si128(_mm_castps_si128(_mm_cmpgt_ps(z, w)), _mm_set1_epi32(clipFar)));
+
+		__m128 guard = _mm_or_ps(_mm_or_ps(_mm_cmplt_ps(x, neg_guard_w), _mm_cmpgt_ps(x, guard_w)),
+			_mm_or_ps(_mm_cmplt_ps(y, neg_guard_w), _mm_cmpgt_ps(y, guard_w)));
+		__m128i inside_sides = _mm_cmpeq_epi32(_mm_and_si128(code, _mm_set1_epi32(clipSides)), _mm_setzero_si128());
+		code = _mm_or_si128(code, _mm_andnot_si128(inside_sides, _mm_and_si128(_mm_castps_si128(guard), _mm_set1_epi32(clipGuardBand))));
+
+		clip_code[half] = code;
+	}
+
+	__m128i packed = _mm_packs_epi32(clip_code[0], clip_code[1]);
+	_mm_storel_epi64(reinterpret_cast<__m128i*>(pClipCodes), _mm_packus_epi16(packed, packed));
+}
 
-static const std::bitset<6> Bottom("100");
-static const std::bitset<6> Top("1000");
+//clipping a triangle against one plane leaves at most two, so the six planes split it into at most 64
+static constexpr size_t maxClipTriangleNum = 64;
+//every split adds two vertices to the three the triangle started with
+static constexpr size_t maxClipVertexNum = 3 + 2 * (maxClipTriangleNum - 1);
+static constexpr size_t newClipVertex = ~size_t(0);
 
-static const std::bitset<6> Near("10000");
-static const std::bitset<6> Far("100000");
+//near and far go first, they are the planes most clipping happens against
+static const size_t clipPlaneOrder[6] = { 4, 5, 0, 1, 2, 3 };
+
+//vertices of a triangle being clipped and of all its splits, on the stack.
+//m_index is the index of a vertex in the output, or newClipVertex until a finished triangle uses it
+struct ClipVertexPool
+{
+	Fragment m_vertex[maxClipVertexNum];
+	size_t m_index[maxClipVertexNum];
+	size_t m_vertex_num;
+};
+
+//splits of a triangle, they refer to their vertices by position in the pool
+struct ClipTriangleList
+{
+	uint8_t m_vertex[maxClipTriangleNum][3];
+	size_t m_tri_num;
+};
 
 using ClipperInterpolationFun = std::function<void(const Fragment &pFragment0, const Fragment &pFragment1, const float &t, Fragment &pDest)>;
 
-inline void BaseInterpolationFun(const Fragment &pFragment0, const Fragment &pFragment1, const float &t, Fragment &pDest)
+inline void LerpVarying(const float *pData0, const float *pData1, const float &t, const size_t &pOffset, const size_t &pSize, float *pDest)
 {
-	pDest.m_normal = pFragment0.m_normal * (1 - t) + pFragment1.m_normal * t;
-	pDest.m_uv = pFragment0.m_uv * (1 - t) + pFragment1.m_uv * t;
+	for (size_t i = pOffset; i < pOffset + pSize; i++)
+	{
+		pDest[i] = pData0[i] * (1 - t) + pData1[i] * t;
+	}
 }
 
-inline void Extension0InterpolationFun(const Fragment &pFragment0, const Fragment &pFragment1, const float &t, Fragment &pDest)
+//stateless form for varyings known at compile time, a pipeline passes it so the clipper loops can inline it
+template<typename Layout>
+struct ClipperInterpolation;
+
+template<typename... Attributes>
+struct ClipperInterpolation<Varyings<Attributes...>>
 {
-	pDest.m_normal = pFragment0.m_normal * (1 - t) + pFragment1.m_normal * t;
-	pDest.m_uv = pFragment0.m_uv * (1 - t) + pFragment1.m_uv * t;
-	pDest.pack0 = pFragment0.pack0 * (1 - t) + pFragment1.pack0 * t;
-}
+	void operator()(const Fragment &pFragment0, const Fragment &pFragment1, const float &t, Fragment &pDest) const
+	{
+		const float *data0 = FragmentData(pFragment0);
+		const float *data1 = FragmentData(pFragment1);
+		float *dest = FragmentData(pDest);
+
+		int expand[] = { 0, (LerpVarying(data0, data1, t, Attributes::offset, Attributes::size, dest), 0)... };
+		(void)expand;
+	}
+};
 
-inline void Extension1InterpolationFun(const Fragment &pFragment0, const Fragment &pFragment1, const float &t, Fragment &pDest)
+inline ClipperInterpolationFun GetClipperInterpolationFun(const VaryingLayout &pLayout)
 {
-	pDest.m_normal = pFragment0.m_normal * (1 - t) + pFragment1.m_normal * t;
-	pDest.m_uv = pFragment0.m_uv * (1 - t) + pFragment1.m_uv * t;
-	pDest.pack0 = pFragment0.pack0 * (1 - t) + pFragment1.pack0 * t;
-	pDest.pack1 = pFragment0.pack1 * (1 - t) + pFragment1.pack1 * t;
+	return [pLayout](const Fragment &pFragment0, const Fragment &pFragment1, const float &t, Fragment &pDest) {
+		for (size_t i = 0; i < pLayout.m_count; i++)
+		{
+			LerpVarying(FragmentData(pFragment0), FragmentData(pFragment1), t, pLayout.m_offset[i], pLayout.m_size[i], FragmentData(pDest));
+		}
+	};
 }
 
+//triangles of a draw are clipped in chunks of this many, one chunk per task
+static constexpr size_t clipChunkSize = 1024;
+
+//output of the chunks one worker clipped, kept between draws so it stops allocating once it is large enough
+struct ClipStream
+{
+	std::vector<IndexedTriangle> m_tris;
+	std::vector<Fragment> m_vertices;
+};
+
+//where the output of a chunk lies in the stream of the worker that clipped it
+struct ClipChunk
+{
+	ClipStream *m_stream;
+	size_t m_tri_begin;
+	size_t m_tri_end;
+	size_t m_vertex_begin;
+	size_t m_vertex_end;
+};
+
 class Clipper
 {
 public:
-	Clipper() 
+#ifdef PARALL
+	Clipper() : m_streams([]() { return std::make_shared<ClipStream>(); })
+#else
+	Clipper()
+#endif // PARALL
 	{
-		m_inter_fun = BaseInterpolationFun;
+		m_inter_fun = ClipperInterpolation<BaseVaryings>();
+		m_cull_mode = CULL_MODE::BACK;
+		m_guard_band = true;
 	}
 	~Clipper() {}
 
@@ -107,386 +328,430 @@ public:
 		switch (layout)
 		{
 		case FragmentLayout::BASE:
-			m_inter_fun = BaseInterpolationFun;
+			m_inter_fun = ClipperInterpolation<BaseVaryings>();
 			break;
 		case FragmentLayout::EXTENSION0:
-			m_inter_fun = Extension0InterpolationFun;
+			m_inter_fun = ClipperInterpolation<Extension0Varyings>();
 			break;
 		case FragmentLayout::EXTENSION1:
-			m_inter_fun = Extension1InterpolationFun;
+			m_inter_fun = ClipperInterpolation<Extension1Varyings>();
 			break;
 		default:
 			break;
 		}
 	}
 
-	void Clip(Triangle **pTris, size_t &pSize)
+	void SetVaryingLayout(const VaryingLayout &pLayout)
 	{
-		std::vector<Triangle> clipped_tris;
-		clipped_tris.reserve(pSize);
-
-		for (size_t i = 0; i < pSize; i++)
-		{
-			Triangle curr_tri = (*pTris)[i];
-
-			Fragment vertex0 = curr_tri.m_vertex[0];
-			Fragment vertex1 = curr_tri.m_vertex[1];
-			Fragment vertex2 = curr_tri.m_vertex[2];
+		m_inter_fun = GetClipperInterpolationFun(pLayout);
+	}
 
-			Vec4f v0 = vertex0.m_pos;
-			Vec4f v1 = vertex1.m_pos;
-			Vec4f v2 = vertex2.m_pos;
+	void SetCullMode(const CULL_MODE &pMode)
+	{
+		m_cull_mode = pMode;
+	}
 
-			std::bitset<6> clip_code[3];
+	//when disabled triangles are clipped against the viewport planes themselves
+	void SetGuardBand(const bool &pEnable)
+	{
+		m_guard_band = pEnable;
+	}
 
-			clip_code[0] = ComputeClipCode(v0);
-			clip_code[1] = ComputeClipCode(v1);
-			clip_code[2] = ComputeClipCode(v2);
+	//drops culled and zero area triangles right after assembly, keeping the order of the rest.
+	//triangles with a vertex at w <= 0 are left to the clipper and the raster setup
+	void Cull(ArenaVector<IndexedTriangle> &pTris, const ArenaVector<Fragment> &pVertices) const
+	{
+		size_t kept_num = 0;
 
-			std::bitset<6> clip_code_and = clip_code[0] & clip_code[1] & clip_code[2];
-			std::bitset<6> clip_code_or = clip_code[0] | clip_code[1] | clip_code[2];
+		for (size_t i = 0; i < pTris.size(); i++)
+		{
+			const IndexedTriangle &curr_tri = pTris[i];
 
-			if (clip_code_and != Inside)
+			if (!IsCulled(pVertices[curr_tri.m_vertex[0]].m_pos, pVertices[curr_tri.m_vertex[1]].m_pos, pVertices[curr_tri.m_vertex[2]].m_pos))
 			{
-				continue;
+				pTris[kept_num++] = curr_tri;
 			}
+		}
 
-			if (clip_code_or == Inside)
-			{
-				clipped_tris.emplace_back((*pTris)[i]);
-				continue;
-			}
+		pTris.resize(kept_num);
+	}
 
-			std::bitset<6> clip_code_xor = (clip_code[0] ^ clip_code[1]) | (clip_code[1] ^ clip_code[2]) | (clip_code[2] ^ clip_code[0]);
+	//triangles that are completely inside keep referring to the shaded vertices,
+	//only vertices created by clipping are appended to pVertices.
+	//pTris and pVertices grow at most once, to the size the clipping produced.
+	//pClipCodes holds ComputeVertexClipCode of every shaded vertex
+	void Clip(ArenaVector<IndexedTriangle> &pTris, ArenaVector<Fragment> &pVertices, const ArenaVector<uint8_t> &pClipCodes)
+	{
+		Clip(pTris, pVertices, pClipCodes, m_inter_fun);
+	}
 
-			std::vector<Triangle> unclipped_tris;
-			std::vector<Triangle> curr_cliped_tirs;
+	//chunks are clipped in parallel and concatenated in order, so the output is the same as clipping serially
+	template<typename InterpolationFun>
+	void Clip(ArenaVector<IndexedTriangle> &pTris, ArenaVector<Fragment> &pVertices, const ArenaVector<uint8_t> &pClipCodes, const InterpolationFun &pInterFun)
+	{
+		size_t vertex_num = pVertices.size();
+		size_t chunk_num = (pTris.size() + clipChunkSize - 1) / clipChunkSize;
 
-			unclipped_tris.emplace_back(curr_tri);
+#ifdef PARALL
+		if (chunk_num > 1)
+		{
+			m_streams.combine_each([](const std::shared_ptr<ClipStream> &pStream) {
+				pStream->m_tris.clear();
+				pStream->m_vertices.clear();
+			});
 
-			if ((clip_code_xor & Near) == Near)
-			{
-				for (size_t i = 0; i < unclipped_tris.size(); i++)
-				{
-					ClipPlane(unclipped_tris[i],
-						[](const Vec4f &p) {
-						return p.z < 0;
-					},
-						[](const Vec4f &p0, const Vec4f &p1) {
-						return p0.z / (p0.z - p1.z);
-					},
-						[](Vec4f &p) {
-						p.z = 0;
-					}, curr_cliped_tirs);
-				}
+			ArenaVector<ClipChunk> chunks(chunk_num, ArenaAllocator<ClipChunk>(pTris.get_allocator()));
 
-				if (FilterTriangles(curr_cliped_tirs, clipped_tris))
-				{
-					continue;
-				}
+			//new vertices are numbered from vertex_num in the stream and renumbered when the streams are concatenated
+			concurrency::parallel_for(size_t(0), chunk_num, [&](const size_t &i) {
+				ClipStream &stream = *m_streams.local();
+				ClipChunk &chunk = chunks[i];
 
-				std::swap(curr_cliped_tirs, unclipped_tris);
-				curr_cliped_tirs.clear();
-			}
+				chunk.m_stream = &stream;
+				chunk.m_tri_begin = stream.m_tris.size();
+				chunk.m_vertex_begin = stream.m_vertices.size();
 
-			if ((clip_code_xor & Far) == Far)
-			{
-				for (size_t i = 0; i < unclipped_tris.size(); i++)
-				{
-					ClipPlane(unclipped_tris[i],
-						[](const Vec4f &p) {
-						return p.z > p.w;
-					},
-						[](const Vec4f &p0, const Vec4f &p1)
-					{
-						return (p0.z - p0.w) / ((p0.z - p0.w) - (p1.z - p1.w));
-					},
-						[](Vec4f &p) {
-						p.z = p.w;
-					}, curr_cliped_tirs);
-				}
+				ClipRange(pTris, i * clipChunkSize, min((i + 1) * clipChunkSize, pTris.size()), pVertices, pClipCodes, vertex_num, pInterFun, stream);
 
-				if (FilterTriangles(curr_cliped_tirs, clipped_tris))
-				{
-					continue;
-				}
+				chunk.m_tri_end = stream.m_tris.size();
+				chunk.m_vertex_end = stream.m_vertices.size();
+			});
 
-				std::swap(curr_cliped_tirs, unclipped_tris);
-				curr_cliped_tirs.clear();
+			size_t tri_total = 0;
+			size_t vertex_total = vertex_num;
+			for (size_t i = 0; i < chunk_num; i++)
+			{
+				tri_total += chunks[i].m_tri_end - chunks[i].m_tri_begin;
+				vertex_total += chunks[i].m_vertex_end - chunks[i].m_vertex_begin;
 			}
 
-			if ((clip_code_xor & Left) == Left)
+			pTris.clear();
+			pTris.reserve(tri_total);
+			pVertices.reserve(vertex_total);
+
+			for (size_t i = 0; i < chunk_num; i++)
 			{
-				for (size_t i = 0; i < unclipped_tris.size(); i++)
+				const ClipChunk &chunk = chunks[i];
+				size_t vertex_offset = pVertices.size();
+
+				pVertices.insert(pVertices.end(), chunk.m_stream->m_vertices.begin() + chunk.m_vertex_begin, chunk.m_stream->m_vertices.begin() + chunk.m_vertex_end);
+
+				for (size_t j = chunk.m_tri_begin; j < chunk.m_tri_end; j++)
 				{
-					ClipPlane(unclipped_tris[i],
-						[](const Vec4f &p) {
-						return p.x < -p.w;
-					},
-						[](const Vec4f &p0, const Vec4f &p1)
+					IndexedTriangle tri = chunk.m_stream->m_tris[j];
+					for (size_t k = 0; k < 3; k++)
 					{
-						return (p0.x + p0.w) / ((p0.x + p0.w) - (p1.x + p1.w));
-					},
-						[](Vec4f &p) {
-						p.x = -p.w;
-					}, curr_cliped_tirs);
+						if (tri.m_vertex[k] >= vertex_num)
+						{
+							tri.m_vertex[k] = tri.m_vertex[k] - vertex_num - chunk.m_vertex_begin + vertex_offset;
+						}
+					}
+					pTris.emplace_back(tri);
 				}
+			}
 
-				if (FilterTriangles(curr_cliped_tirs, clipped_tris))
-				{
-					continue;
-				}
+			return;
+		}
+#endif // PARALL
 
-				std::swap(curr_cliped_tirs, unclipped_tris);
-				curr_cliped_tirs.clear();
-			}
+		m_stream.m_tris.clear();
+		m_stream.m_vertices.clear();
 
-			if ((clip_code_xor & Right) == Right)
-			{
-				for (size_t i = 0; i < unclipped_tris.size(); i++)
-				{
-					ClipPlane(unclipped_tris[i],
-						[](const Vec4f &p) {
-						return p.x > p.w;
-					},
-						[](const Vec4f &p0, const Vec4f &p1)
-					{
-						return (p0.x - p0.w) / ((p0.x - p0.w) - (p1.x - p1.w));
-					},
-						[](Vec4f &p) {
-						p.x = p.w;
-					}, curr_cliped_tirs);
-				}
+		ClipRange(pTris, 0, pTris.size(), pVertices, pClipCodes, vertex_num, pInterFun, m_stream);
 
-				if (FilterTriangles(curr_cliped_tirs, clipped_tris))
-				{
-					continue;
-				}
+		pTris.clear();
+		pTris.reserve(m_stream.m_tris.size());
+		pTris.insert(pTris.end(), m_stream.m_tris.begin(), m_stream.m_tris.end());
+
+		pVertices.reserve(vertex_num + m_stream.m_vertices.size());
+		pVertices.insert(pVertices.end(), m_stream.m_vertices.begin(), m_stream.m_vertices.end());
+	}
+private:
+	//clips pTris[pBegin, pEnd) into pOut, new vertices are numbered from pNewIndexBase plus their position in the stream
+	template<typename InterpolationFun>
+	void ClipRange(const ArenaVector<IndexedTriangle> &pTris, const size_t &pBegin, const size_t &pEnd, const ArenaVector<Fragment> &pVertices,
+		const ArenaVector<uint8_t> &pClipCodes, const size_t &pNewIndexBase, const InterpolationFun &pInterFun, ClipStream &pOut) const
+	{
+		ClipVertexPool pool;
+
+		for (size_t i = pBegin; i < pEnd; i++)
+		{
+			const IndexedTriangle &curr_tri = pTris[i];
 
-				std::swap(curr_cliped_tirs, unclipped_tris);
-				curr_cliped_tirs.clear();
+			uint8_t clip_code0 = pClipCodes[curr_tri.m_vertex[0]];
+			uint8_t clip_code1 = pClipCodes[curr_tri.m_vertex[1]];
+			uint8_t clip_code2 = pClipCodes[curr_tri.m_vertex[2]];
+
+			uint8_t clip_code_and = clip_code0 & clip_code1 & clip_code2 & clipPlanes;
+			uint8_t clip_code_or = clip_code0 | clip_code1 | clip_code2;
+
+			if (clip_code_and != 0)
+			{
+				continue;
 			}
 
-			if ((clip_code_xor & Bottom) == Bottom)
+			if ((clip_code_or & clipPlanes) == 0)
 			{
-				for (size_t i = 0; i < unclipped_tris.size(); i++)
-				{
-					ClipPlane(unclipped_tris[i],
-						[](const Vec4f &p) {
-						return p.y < -p.w;
-					},
-						[](const Vec4f &p0, const Vec4f &p1)
-					{
-						return (p0.y + p0.w) / ((p0.y + p0.w) - (p1.y + p1.w));
-					},
-						[](Vec4f &p) {
-						p.y = -p.w;
-					}, curr_cliped_tirs);
-				}
+				pOut.m_tris.emplace_back(curr_tri);
+				continue;
+			}
 
-				if (FilterTriangles(curr_cliped_tirs, clipped_tris))
+			//triangles that only cross the side planes inside the guard band are left to the raster bounding box,
+			//the rest is clipped against near, far and the guard band
+			float scale = 1.0f;
+			if (m_guard_band)
+			{
+				if ((clip_code_or & (clipNear | clipFar | clipGuardBand)) == 0)
 				{
+					pOut.m_tris.emplace_back(curr_tri);
 					continue;
 				}
 
-				std::swap(curr_cliped_tirs, unclipped_tris);
-				curr_cliped_tirs.clear();
+				scale = guardBandScale;
 			}
 
-			if ((clip_code_xor & Top) == Top)
+			//the few triangles that are really clipped get their codes against the planes in use,
+			//no plane has all three vertices outside, so the planes crossed are the ones any vertex is outside of
+			uint8_t clip_planes = clip_code_or & clipPlanes;
+			if (m_guard_band)
 			{
-				for (size_t i = 0; i < unclipped_tris.size(); i++)
-				{
-					ClipPlane(unclipped_tris[i],
-						[](const Vec4f &p) {
-						return p.y > p.w;
-					},
-						[](const Vec4f &p0, const Vec4f &p1)
-					{
-						return (p0.y - p0.w) / ((p0.y - p0.w) - (p1.y - p1.w));
-					},
-						[](Vec4f &p) {
-						p.y = p.w;
-					}, curr_cliped_tirs);
-				}
-
-				if (FilterTriangles(curr_cliped_tirs, clipped_tris))
-				{
-					continue;
-				}
+				clip_planes = ComputeClipCode(pVertices[curr_tri.m_vertex[0]].m_pos, scale) |
+					ComputeClipCode(pVertices[curr_tri.m_vertex[1]].m_pos, scale) |
+					ComputeClipCode(pVertices[curr_tri.m_vertex[2]].m_pos, scale);
+			}
 
-				std::swap(curr_cliped_tirs, unclipped_tris);
-				curr_cliped_tirs.clear();
+			pool.m_vertex_num = 3;
+			for (size_t k = 0; k < 3; k++)
+			{
+				pool.m_vertex[k] = pVertices[curr_tri.m_vertex[k]];
+				pool.m_index[k] = curr_tri.m_vertex[k];
 			}
-		}
 
-		size_t clipped_size = clipped_tris.size();
-		if (clipped_size > pSize)
-		{
-			delete[](*pTris);
-			(*pTris) = new Triangle[clipped_size];
+			ClipTriangle(pool, clip_planes, scale, pInterFun, pNewIndexBase, pOut);
 		}
-		pSize = clipped_size;
-		std::memcpy((*pTris), clipped_tris.data(), pSize * sizeof(Triangle));
-		
 	}
-private:
-	std::bitset<6> ComputeClipCode(const Vec4f &pVertex)
+
+	//with every w positive the sign of det(x, y, w) is the winding after perspective division,
+	//clockwise on screen is counter clockwise in ndc space because y is flipped, which makes the determinant negative
+	bool IsCulled(const Vec4f &p0, const Vec4f &p1, const Vec4f &p2) const
 	{
-		std::bitset<6> clip_code;
-		if (pVertex.x < -pVertex.w) //left
+		if (p0.w <= 0 || p1.w <= 0 || p2.w <= 0)
 		{
-			clip_code.set(0, true);
+			return false;
 		}
 
-		if (pVertex.x > pVertex.w) //right
-		{
-			clip_code.set(1, true);
-		}
+		float det = p0.x * (p1.y * p2.w - p2.y * p1.w) + p1.x * (p2.y * p0.w - p0.y * p2.w) + p2.x * (p0.y * p1.w - p1.y * p0.w);
 
-		if (pVertex.y < -pVertex.w) //bottom
+		if (det == 0)
 		{
-			clip_code.set(2, true);
+			return true;
 		}
 
-		if (pVertex.y > pVertex.w) //top
+		bool front = det < 0;
+
+		switch (m_cull_mode)
 		{
-			clip_code.set(3, true);
+		case CULL_MODE::FRONT:
+			return front;
+		case CULL_MODE::BACK:
+			return !front;
+		default:
+			return false;
 		}
+	}
 
-		if (pVertex.z < 0) //near
+	//signed distance to a clip plane, inside is positive
+	float PlaneDistance(const size_t &pPlane, const Vec4f &pPos, const float &pScale) const
+	{
+		switch (pPlane)
 		{
-			clip_code.set(4, true);
+		case 0: //left
+			return pPos.x + pScale * pPos.w;
+		case 1: //right
+			return pScale * pPos.w - pPos.x;
+		case 2: //bottom
+			return pPos.y + pScale * pPos.w;
+		case 3: //top
+			return pScale * pPos.w - pPos.y;
+		case 4: //near
+			return pPos.z;
+		default: //far
+			return pPos.w - pPos.z;
 		}
+	}
 
-		if (pVertex.z > pVertex.w) //far
+	//puts a clipped position exactly on the plane, so later planes and the raster setup see no rounding error
+	void SnapToPlane(const size_t &pPlane, Vec4f &pPos, const float &pScale) const
+	{
+		switch (pPlane)
 		{
-			clip_code.set(5, true);
+		case 0:
+			pPos.x = -pScale * pPos.w;
+			break;
+		case 1:
+			pPos.x = pScale * pPos.w;
+			break;
+		case 2:
+			pPos.y = -pScale * pPos.w;
+			break;
+		case 3:
+			pPos.y = pScale * pPos.w;
+			break;
+		case 4:
+			pPos.z = 0;
+			break;
+		default:
+			pPos.z = pPos.w;
+			break;
 		}
-
-		return clip_code;
 	}
 
-	template<typename PredictFun, typename SolveTFun, typename PositionFun>
-	void ClipPlane(const Triangle &pTriangle, const PredictFun &pPreFun, const SolveTFun &pSolFun, const PositionFun &pPosFun, std::vector<Triangle> &pClipedTris)
+	//splits the triangle in pPool plane by plane, a split that is inside every plane is written out right away and
+	//the rest goes on to the next plane. each split is triangulated on its own instead of clipping one polygon,
+	//the raster interpolates depth per triangle, so a different triangulation would show in the depth buffer
+	template<typename InterpolationFun>
+	void ClipTriangle(ClipVertexPool &pPool, const uint8_t &pClipPlanes, const float &pScale, const InterpolationFun &pInterFun,
+		const size_t &pNewIndexBase, ClipStream &pOut) const
 	{
-		Vec4f vertex_pos[3];
-
-		vertex_pos[0] = pTriangle.m_vertex[0].m_pos;
-		vertex_pos[1] = pTriangle.m_vertex[1].m_pos;
-		vertex_pos[2] = pTriangle.m_vertex[2].m_pos;
+		ClipTriangleList curr_tris;
+		ClipTriangleList split_tris;
 
-		bool predicates[3];
-		predicates[0] = pPreFun(vertex_pos[0]);
-		predicates[1] = pPreFun(vertex_pos[1]);
-		predicates[2] = pPreFun(vertex_pos[2]);
+		curr_tris.m_tri_num = 1;
+		curr_tris.m_vertex[0][0] = 0;
+		curr_tris.m_vertex[0][1] = 1;
+		curr_tris.m_vertex[0][2] = 2;
 
-		if ((predicates[0] ^ predicates[1]) | (predicates[1] ^ predicates[2]) | (predicates[2] ^ predicates[0]))
+		for (size_t plane = 0; plane < 6 && curr_tris.m_tri_num > 0; plane++)
 		{
-			std::vector<Fragment> clip_point;
+			if (!(pClipPlanes & (1 << clipPlaneOrder[plane])))
+			{
+				continue;
+			}
 
-			for (size_t i = 0; i < 3; i++)
+			split_tris.m_tri_num = 0;
+			for (size_t i = 0; i < curr_tris.m_tri_num; i++)
 			{
-				size_t k = (i + 1) % 3;
-				Vec4f pos0 = vertex_pos[i];
-				Vec4f pos1 = vertex_pos[k];
+				ClipTrianglePlane(pPool, curr_tris.m_vertex[i], clipPlaneOrder[plane], pScale, pInterFun, split_tris);
+			}
 
-				bool code0 = predicates[i];
-				bool code1 = predicates[k];
+			curr_tris.m_tri_num = 0;
+			for (size_t i = 0; i < split_tris.m_tri_num; i++)
+			{
+				const uint8_t *tri = split_tris.m_vertex[i];
 
-				if (!code0 && !code1)
-				{
-					clip_point.emplace_back(pTriangle.m_vertex[k]);
-				}
-				else if (code0 && !code1)
-				{
-					float t = pSolFun(pos0, pos1);
-					Vec4f new_point_pos = pos0 * (1 - t) + pos1 * t;
-					pPosFun(new_point_pos);
-					Fragment new_point;
-					new_point.m_pos = new_point_pos;
-					m_inter_fun(pTriangle.m_vertex[i], pTriangle.m_vertex[k], t, new_point);
-					clip_point.emplace_back(new_point);
-					clip_point.emplace_back(pTriangle.m_vertex[k]);
-				}
-				else if (!code0 && code1)
+				uint8_t clip_code0 = ComputeClipCode(pPool.m_vertex[tri[0]].m_pos, pScale);
+				uint8_t clip_code1 = ComputeClipCode(pPool.m_vertex[tri[1]].m_pos, pScale);
+				uint8_t clip_code2 = ComputeClipCode(pPool.m_vertex[tri[2]].m_pos, pScale);
+
+				if ((clip_code0 & clip_code1 & clip_code2) != 0)
 				{
-					float t = pSolFun(pos0, pos1);
-					Vec4f new_point_pos = pos0 * (1 - t) + pos1 * t;
-					pPosFun(new_point_pos);
-					Fragment new_point;
-					new_point.m_pos = new_point_pos;
-					m_inter_fun(pTriangle.m_vertex[i], pTriangle.m_vertex[k], t, new_point);
-					clip_point.emplace_back(new_point);
+					continue;
 				}
-				else
+
+				if ((clip_code0 | clip_code1 | clip_code2) == 0)
 				{
+					EmitTriangle(pPool, tri, pNewIndexBase, pOut);
+					continue;
 				}
-			}
 
-			for (size_t j = 0; j < clip_point.size() - 2; j++)
-			{
-
-				size_t n = (j + 1) % clip_point.size();
-				size_t m = (j + 2) % clip_point.size();
-				Triangle cliped_tri;
-				cliped_tri.m_vertex[0] = clip_point[0];
-				cliped_tri.m_vertex[1] = clip_point[n];
-				cliped_tri.m_vertex[2] = clip_point[m];
-
-				pClipedTris.emplace_back(cliped_tri);
+				uint8_t *kept_tri = curr_tris.m_vertex[curr_tris.m_tri_num++];
+				kept_tri[0] = tri[0];
+				kept_tri[1] = tri[1];
+				kept_tri[2] = tri[2];
 			}
 		}
-		else
-		{
-			pClipedTris.emplace_back(pTriangle);
-		}
 	}
 
-	bool FilterTriangles(std::vector<Triangle> &pCurrClippedTris, std::vector<Triangle> &pClippedTris)
+	//one plane of the split. a triangle crossing the plane becomes a polygon of at most four vertices that is fanned
+	//from its first vertex, intersections are computed from the start of each edge
+	template<typename InterpolationFun>
+	void ClipTrianglePlane(ClipVertexPool &pPool, const uint8_t *pTri, const size_t &pPlane, const float &pScale, const InterpolationFun &pInterFun,
+		ClipTriangleList &pOut) const
 	{
-		std::vector<Triangle> tris_failed;
-		for (size_t i = 0; i < pCurrClippedTris.size(); i++)
+		float distance[3];
+		bool outside[3];
+		for (size_t i = 0; i < 3; i++)
 		{
-			Triangle curr_tri = pCurrClippedTris[i];
-
-			Vec4f v0 = curr_tri.m_vertex[0].m_pos;
-			Vec4f v1 = curr_tri.m_vertex[1].m_pos;
-			Vec4f v2 = curr_tri.m_vertex[2].m_pos;
+			distance[i] = PlaneDistance(pPlane, pPool.m_vertex[pTri[i]].m_pos, pScale);
+			outside[i] = distance[i] < 0;
+		}
 
-			std::bitset<6> clip_code[3];
+		if (outside[0] == outside[1] && outside[1] == outside[2])
+		{
+			uint8_t *same_tri = pOut.m_vertex[pOut.m_tri_num++];
+			same_tri[0] = pTri[0];
+			same_tri[1] = pTri[1];
+			same_tri[2] = pTri[2];
+			return;
+		}
 
-			clip_code[0] = ComputeClipCode(v0);
-			clip_code[1] = ComputeClipCode(v1);
-			clip_code[2] = ComputeClipCode(v2);
+		uint8_t polygon[4];
+		size_t polygon_num = 0;
 
-			std::bitset<6> clip_code_and = clip_code[0] & clip_code[1] & clip_code[2];
-			std::bitset<6> clip_code_or = clip_code[0] | clip_code[1] | clip_code[2];
+		for (size_t i = 0; i < 3; i++)
+		{
+			size_t k = (i + 1) % 3;
 
-			if (clip_code_and != Inside)
+			if (outside[i] != outside[k])
 			{
-				continue;
+				const Fragment &from = pPool.m_vertex[pTri[i]];
+				const Fragment &to = pPool.m_vertex[pTri[k]];
+				float t = distance[i] / (distance[i] - distance[k]);
+
+				//the pool slot is reset, varyings the layout does not interpolate are zero and not left over from another triangle
+				size_t new_vertex = pPool.m_vertex_num++;
+				Fragment &new_point = pPool.m_vertex[new_vertex];
+				new_point = Fragment();
+				new_point.m_pos = from.m_pos * (1 - t) + to.m_pos * t;
+				SnapToPlane(pPlane, new_point.m_pos, pScale);
+				pInterFun(from, to, t, new_point);
+
+				pPool.m_index[new_vertex] = newClipVertex;
+				polygon[polygon_num++] = static_cast<uint8_t>(new_vertex);
 			}
 
-			if (clip_code_or == Inside)
+			if (!outside[k])
 			{
-				pClippedTris.emplace_back(curr_tri);
-				continue;
+				polygon[polygon_num++] = pTri[k];
 			}
-
-			tris_failed.emplace_back(curr_tri);
 		}
 
-		pCurrClippedTris = tris_failed;
+		for (size_t j = 1; j + 1 < polygon_num; j++)
+		{
+			uint8_t *new_tri = pOut.m_vertex[pOut.m_tri_num++];
+			new_tri[0] = polygon[0];
+			new_tri[1] = polygon[j];
+			new_tri[2] = polygon[j + 1];
+		}
+	}
 
-		if (pCurrClippedTris.size() != 0)
+	//vertices the clipper did not touch keep their index, a new vertex is appended the first time a finished triangle uses it
+	void EmitTriangle(ClipVertexPool &pPool, const uint8_t *pTri, const size_t &pNewIndexBase, ClipStream &pOut) const
+	{
+		IndexedTriangle new_tri;
+		for (size_t k = 0; k < 3; k++)
 		{
-			return false;
+			if (pPool.m_index[pTri[k]] == newClipVertex)
+			{
+				pPool.m_index[pTri[k]] = pNewIndexBase + pOut.m_vertices.size();
+				pOut.m_vertices.emplace_back(pPool.m_vertex[pTri[k]]);
+			}
+
+			new_tri.m_vertex[k] = pPool.m_index[pTri[k]];
 		}
 
-		return true;
+		pOut.m_tris.emplace_back(new_tri);
 	}
 
 	ClipperInterpolationFun m_inter_fun;
+	CULL_MODE m_cull_mode;
+	bool m_guard_band;
+
+	//output of draws clipped serially
+	ClipStream m_stream;
+
+#ifdef PARALL
+	concurrency::combinable<std::shared_ptr<ClipStream>> m_streams;
+#endif // PARALL
 };
 #endif 
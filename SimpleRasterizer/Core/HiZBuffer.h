@@ -0,0 +1,42 @@
+#pragma once
+#ifndef HIZBUFFER_H
+#define HIZBUFFER_H
+#include "PCH.h"
+
+//farthest depth of every blockSize * blockSize block of the depth buffer, only ever an upper bound
+class HiZBuffer
+{
+public:
+	HiZBuffer(const size_t &pBlockSize) : m_block_size(pBlockSize), m_block_num_x(0), m_block_num_y(0) {};
+	~HiZBuffer() {};
+
+	void Resize(const size_t &pWidth, const size_t &pHeight)
+	{
+		m_block_num_x = (pWidth + m_block_size - 1) / m_block_size;
+		m_block_num_y = (pHeight + m_block_size - 1) / m_block_size;
+		m_max_z.resize(m_block_num_x * m_block_num_y);
+	}
+
+	void Clear(const float &pDepth)
+	{
+		std::fill(m_max_z.begin(), m_max_z.end(), pDepth);
+	}
+
+	//pX and pY are the raster position of the block corner
+	float GetBlockMaxZ(const int &pX, const int &pY) const
+	{
+		return m_max_z[(pY / m_block_size) * m_block_num_x + pX / m_block_size];
+	}
+
+	void SetBlockMaxZ(const int &pX, const int &pY, const float &pDepth)
+	{
+		m_max_z[(pY / m_block_size) * m_block_num_x + pX / m_block_size] = pDepth;
+	}
+
+private:
+	std::vector<float> m_max_z;
+	size_t m_block_size;
+	size_t m_block_num_x;
+	size_t m_block_num_y;
+};
+#endif // !HIZBUFFER_H
@@ -122,6 +122,15 @@ struct ImageDesc
 	size_t m_height;
 };
 
+//raw view of an image bound as render target, written without going through the image object
+struct RenderTargetView
+{
+	void *m_data;
+	size_t m_width;
+	size_t m_height;
+	IMAGE_FORMAT m_format;
+};
+
 class Image
 {
 public:
@@ -224,6 +233,17 @@ protected:
 		m_flag = IMAGE_BIND_FLAG::SHADER_RESOURCE;
 	}
 
+	//only valid while the image keeps its storage, ResizeImage invalidates it
+	RenderTargetView GetRenderTargetView()
+	{
+		RenderTargetView view;
+		view.m_data = m_data;
+		view.m_width = m_desc.m_width;
+		view.m_height = m_desc.m_height;
+		view.m_format = m_desc.m_format;
+		return view;
+	}
+
 	void BindRenderTarget()
 	{
 		if (m_flag == IMAGE_BIND_FLAG::SHADER_RESOURCE)
@@ -316,4 +336,68 @@ public:
 private:
 	std::string m_name;
 };
+
+//how a shader output is stored into a render target of a given format
+template<IMAGE_FORMAT Format>
+struct RenderTargetFormat;
+
+template<>
+struct RenderTargetFormat<IMAGE_FORMAT::R32_FLOAT>
+{
+	static void Store(const RenderTargetView &pView, const Vec2I &pIndex, const Vec4f &pOut)
+	{
+		*(static_cast<float*>(pView.m_data) + pIndex.x + pIndex.y * pView.m_width) = pOut.x;
+	}
+};
+
+template<>
+struct RenderTargetFormat<IMAGE_FORMAT::R32G32_FLOAT>
+{
+	static void Store(const RenderTargetView &pView, const Vec2I &pIndex, const Vec4f &pOut)
+	{
+		*(static_cast<Vec2f*>(pView.m_data) + pIndex.x + pIndex.y * pView.m_width) = Vec2f(pOut.x, pOut.y);
+	}
+};
+
+template<>
+struct RenderTargetFormat<IMAGE_FORMAT::R32G32B32_FLOAT>
+{
+	static void Store(const RenderTargetView &pView, const Vec2I &pIndex, const Vec4f &pOut)
+	{
+		*(static_cast<Vec3f*>(pView.m_data) + pIndex.x + pIndex.y * pView.m_width) = Vec3f(pOut.x, pOut.y, pOut.z);
+	}
+};
+
+template<>
+struct RenderTargetFormat<IMAGE_FORMAT::R32G32B32A32_FLOAT>
+{
+	static void Store(const RenderTargetView &pView, const Vec2I &pIndex, const Vec4f &pOut)
+	{
+		*(static_cast<Vec4f*>(pView.m_data) + pIndex.x + pIndex.y * pView.m_width) = pOut;
+	}
+};
+
+//8 bit targets are presented by the swap chain, so they are stored as bgra with y flipped
+template<>
+struct RenderTargetFormat<IMAGE_FORMAT::R8G8B8A8_UINT>
+{
+	static void Store(const RenderTargetView &pView, const Vec2I &pIndex, const Vec4f &pOut)
+	{
+		*(static_cast<Vec4<uint8_t>*>(pView.m_data) + pIndex.x + (pView.m_height - 1 - pIndex.y) * pView.m_width) =
+			Vec4<uint8_t>(static_cast<uint8_t>(pOut.b * 255), static_cast<uint8_t>(pOut.g * 255), static_cast<uint8_t>(pOut.r * 255), 1);
+	}
+};
+
+using RenderTargetStoreFun = void(*)(const RenderTargetView &pView, const Vec2I &pIndex, const Vec4f &pOut);
+
+inline RenderTargetStoreFun GetRenderTargetStoreFun(const IMAGE_FORMAT &pFormat)
+{
+	static const RenderTargetStoreFun store_fun[5] = {
+		&RenderTargetFormat<IMAGE_FORMAT::R32_FLOAT>::Store,
+		&RenderTargetFormat<IMAGE_FORMAT::R32G32_FLOAT>::Store,
+		&RenderTargetFormat<IMAGE_FORMAT::R32G32B32_FLOAT>::Store,
+		&RenderTargetFormat<IMAGE_FORMAT::R32G32B32A32_FLOAT>::Store,
+		&RenderTargetFormat<IMAGE_FORMAT::R8G8B8A8_UINT>::Store };
+	return store_fun[pFormat];
+}
 #endif // !IMAGE_H
@@ -0,0 +1,80 @@
+#pragma once
+#ifndef PACKETSHADER_H
+#define PACKETSHADER_H
+#include "PCH.h"
+#include "WideVector.h"
+#include "Rasterizer.h"
+#include "Image.h"
+#include <type_traits>
+
+//a packet shader runs its body once for all lanes of a packet, like an spmd program with one program instance per pixel.
+//it is called as void(const FragmentPacket&, FragmentPacketOut*) and works on the 8 wide vectors of WideVector.h
+static_assert(rowWidth == 8, "packet shaders work on Float8 lanes");
+
+template<typename PS, typename = void>
+struct IsPacketShader : std::false_type {};
+
+template<typename PS>
+struct IsPacketShader<PS, decltype(std::declval<const PS&>()(std::declval<const FragmentPacket&>(), std::declval<FragmentPacketOut*>()), void())> : std::true_type {};
+
+//pOffset is the offset of a varying in floats, such as NormalVarying::offset
+inline Float8 LoadPacketScalar(const FragmentPacket &pPacket, const size_t &pOffset)
+{
+	return Float8(_mm_load_ps(pPacket.m_value[pOffset]), _mm_load_ps(pPacket.m_value[pOffset] + 4));
+}
+
+inline Vec2f8 LoadPacketVector2(const FragmentPacket &pPacket, const size_t &pOffset)
+{
+	return Vec2f8(LoadPacketScalar(pPacket, pOffset), LoadPacketScalar(pPacket, pOffset + 1));
+}
+
+inline Vec3f8 LoadPacketVector3(const FragmentPacket &pPacket, const size_t &pOffset)
+{
+	return Vec3f8(LoadPacketScalar(pPacket, pOffset), LoadPacketScalar(pPacket, pOffset + 1), LoadPacketScalar(pPacket, pOffset + 2));
+}
+
+inline Vec4f8 LoadPacketVector4(const FragmentPacket &pPacket, const size_t &pOffset)
+{
+	return Vec4f8(LoadPacketScalar(pPacket, pOffset), LoadPacketScalar(pPacket, pOffset + 1), LoadPacketScalar(pPacket, pOffset + 2),
+		LoadPacketScalar(pPacket, pOffset + 3));
+}
+
+inline void StorePacketVector4(FragmentPacketOut &pOut, const Vec4f8 &pColor)
+{
+	const Float8 *channel[4] = { &pColor.x, &pColor.y, &pColor.z, &pColor.w };
+	for (int i = 0; i < 4; i++)
+	{
+		_mm_store_ps(pOut.m_value[i], channel[i]->m_value[0]);
+		_mm_store_ps(pOut.m_value[i] + 4, channel[i]->m_value[1]);
+	}
+}
+
+//point sampling like SampleTexturePoint, only the lanes in pMask are fetched and the others are zero.
+//texel fetches are not contiguous, so they stay scalar
+inline Vec3f8 SampleTexturePoint(const ExtensionImage<Vec3f> &pImage, const Vec2f8 &pIndex, const int &pMask)
+{
+	float u[rowWidth], v[rowWidth];
+	pIndex.x.Store(u);
+	pIndex.y.Store(v);
+
+	float texel[3][rowWidth] = {};
+	float width = static_cast<float>(pImage.GetWidth());
+	float height = static_cast<float>(pImage.GetHeight());
+
+	for (int k = 0; k < rowWidth; k++)
+	{
+		if ((pMask & (1 << k)) == 0)
+		{
+			continue;
+		}
+
+		Vec2I index(static_cast<int>(min(std::round(u[k] * width), width - 1)), static_cast<int>(min(std::round(v[k] * height), height - 1)));
+		const Vec3f &color = pImage.GetPixel(index);
+		texel[0][k] = color.x;
+		texel[1][k] = color.y;
+		texel[2][k] = color.z;
+	}
+
+	return Vec3f8(Float8::Load(texel[0]), Float8::Load(texel[1]), Float8::Load(texel[2]));
+}
+#endif // !PACKETSHADER_H
@@ -0,0 +1,225 @@
+#pragma once
+#ifndef PIPELINE_H
+#define PIPELINE_H
+#include "PCH.h"
+#include "Arena.h"
+#include "Clipper.h"
+#include "Rasterizer.h"
+#include "Image.h"
+#include "PacketShader.h"
+#include "VertexBatch.h"
+
+//the stages of a draw that run once per vertex or fragment, the context calls them once per stage or per triangle
+class PipelineState
+{
+public:
+	virtual ~PipelineState() {};
+
+	virtual size_t GetRenderTargetNum() const = 0;
+	virtual IMAGE_FORMAT GetRenderTargetFormat(const size_t &pIndex) const = 0;
+
+	//also writes the clip code of every shaded vertex
+	virtual void ShadeVertices(const Vertex *pVertices, const ArenaVector<unsigned char> &pReferenced, ArenaVector<Fragment> &pVertexOut, ArenaVector<uint8_t> &pClipCodes) const = 0;
+
+	virtual void Clip(Clipper &pClipper, ArenaVector<IndexedTriangle> &pTris, ArenaVector<Fragment> &pVertices, const ArenaVector<uint8_t> &pClipCodes) const = 0;
+
+	virtual void Rasterize(Rasterizer &pRasterizer, const RasterTriangle &pTriangle, const Vec2I &pTileMin, const Vec2I &pTileMax,
+		ArenaVector<Fragment> &pFragments, ArenaVector<Vec2I> &pFragmentIndexes, const std::shared_ptr<ExtensionImage<float>> &pDepthBuffer, HiZBuffer &pHiZBuffer) const = 0;
+
+	//shades a batch and writes it to the targets in rasterization order
+	virtual void ShadeFragments(const ArenaVector<Fragment> &pFragments, const ArenaVector<Vec2I> &pFragmentIndexes, ArenaVector<Vec4f> &pFragmentOut,
+		const RenderTargetView *pTargets) const = 0;
+
+	//true when the fragment shader takes packets, the draw then uses the two below instead of Rasterize and ShadeFragments
+	virtual bool IsPacketShading() const = 0;
+
+	virtual void RasterizePackets(Rasterizer &pRasterizer, const RasterTriangle &pTriangle, const Vec2I &pTileMin, const Vec2I &pTileMax,
+		ArenaVector<FragmentPacket> &pPackets, const std::shared_ptr<ExtensionImage<float>> &pDepthBuffer, HiZBuffer &pHiZBuffer) const = 0;
+
+	virtual void ShadePackets(const ArenaVector<FragmentPacket> &pPackets, ArenaVector<FragmentPacketOut> &pPacketOut, const RenderTargetView *pTargets) const = 0;
+};
+
+//shaders, varyings and render target formats fixed at compile time, Layout is a Varyings list such as BaseVaryings.
+//VS is called as void(const Vertex&, Fragment&) and PS as void(const Fragment&, Vec4f**) like the dynamic shaders,
+//or VS is a batch vertex shader called as void(const VertexBatch&, VertexBatchOut&)
+//and PS is a packet shader called as void(const FragmentPacket&, FragmentPacketOut*)
+template<typename VS, typename PS, typename Layout, IMAGE_FORMAT... RTFormats>
+class Pipeline : public PipelineState
+{
+public:
+	Pipeline(const VS &pVertexShader = VS(), const PS &pFragmentShader = PS()) : m_vertex_shader(pVertexShader), m_fragment_shader(pFragmentShader) {};
+	~Pipeline() {};
+
+	virtual size_t GetRenderTargetNum() const override
+	{
+		return sizeof...(RTFormats);
+	}
+
+	virtual IMAGE_FORMAT GetRenderTargetFormat(const size_t &pIndex) const override
+	{
+		if (pIndex >= sizeof...(RTFormats))
+		{
+			throw std::exception("Error: render target index is out of range");
+		}
+
+		//one element more, a depth only pipeline has no formats and an array can not be empty
+		static const IMAGE_FORMAT formats[sizeof...(RTFormats) + 1] = { RTFormats... };
+		return formats[pIndex];
+	}
+
+	virtual void ShadeVertices(const Vertex *pVertices, const ArenaVector<unsigned char> &pReferenced, ArenaVector<Fragment> &pVertexOut, ArenaVector<uint8_t> &pClipCodes) const override
+	{
+		ShadeVertices(pVertices, pReferenced, pVertexOut, pClipCodes, BatchVertexShading());
+	}
+
+	virtual void Clip(Clipper &pClipper, ArenaVector<IndexedTriangle> &pTris, ArenaVector<Fragment> &pVertices, const ArenaVector<uint8_t> &pClipCodes) const override
+	{
+		pClipper.Clip(pTris, pVertices, pClipCodes, ClipperInterpolation<Layout>());
+	}
+
+	virtual void Rasterize(Rasterizer &pRasterizer, const RasterTriangle &pTriangle, const Vec2I &pTileMin, const Vec2I &pTileMax,
+		ArenaVector<Fragment> &pFragments, ArenaVector<Vec2I> &pFragmentIndexes, const std::shared_ptr<ExtensionImage<float>> &pDepthBuffer, HiZBuffer &pHiZBuffer) const override
+	{
+		pRasterizer.Rasterize(pTriangle, pTileMin, pTileMax, pFragments, pFragmentIndexes, pDepthBuffer, pHiZBuffer, RasterizerInterpolation<Layout>());
+	}
+
+	virtual void ShadeFragments(const ArenaVector<Fragment> &pFragments, const ArenaVector<Vec2I> &pFragmentIndexes, ArenaVector<Vec4f> &pFragmentOut,
+		const RenderTargetView *pTargets) const override
+	{
+		ShadeFragments(pFragments, pFragmentIndexes, pFragmentOut, pTargets, PacketShading());
+	}
+
+	virtual bool IsPacketShading() const override
+	{
+		return PacketShading::value;
+	}
+
+	virtual void RasterizePackets(Rasterizer &pRasterizer, const RasterTriangle &pTriangle, const Vec2I &pTileMin, const Vec2I &pTileMax,
+		ArenaVector<FragmentPacket> &pPackets, const std::shared_ptr<ExtensionImage<float>> &pDepthBuffer, HiZBuffer &pHiZBuffer) const override
+	{
+		pRasterizer.RasterizePackets(pTriangle, pTileMin, pTileMax, pPackets, pDepthBuffer, pHiZBuffer, RasterizerInterpolation<Layout>());
+	}
+
+	virtual void ShadePackets(const ArenaVector<FragmentPacket> &pPackets, ArenaVector<FragmentPacketOut> &pPacketOut, const RenderTargetView *pTargets) const override
+	{
+		ShadePackets(pPackets, pPacketOut, pTargets, PacketShading());
+	}
+
+private:
+	using PacketShading = IsPacketShader<PS>;
+	using BatchVertexShading = IsBatchVertexShader<VS>;
+	static constexpr size_t rtv_num = sizeof...(RTFormats);
+
+	//only the overloads matching the shader are instantiated
+	void ShadeVertices(const Vertex *pVertices, const ArenaVector<unsigned char> &pReferenced, ArenaVector<Fragment> &pVertexOut, ArenaVector<uint8_t> &pClipCodes, std::false_type) const
+	{
+#ifdef PARALL
+		concurrency::parallel_for(size_t(0), pVertexOut.size(), [&](const size_t &i) {
+			if (pReferenced[i])
+			{
+				m_vertex_shader(pVertices[i], pVertexOut[i]);
+				pClipCodes[i] = ComputeVertexClipCode(pVertexOut[i].m_pos);
+			}
+		});
+#else
+		for (size_t i = 0; i < pVertexOut.size(); i++)
+		{
+			if (pReferenced[i])
+			{
+				m_vertex_shader(pVertices[i], pVertexOut[i]);
+				pClipCodes[i] = ComputeVertexClipCode(pVertexOut[i].m_pos);
+			}
+		}
+#endif // PARALL
+	}
+
+	void ShadeVertices(const Vertex *pVertices, const ArenaVector<unsigned char> &pReferenced, ArenaVector<Fragment> &pVertexOut, ArenaVector<uint8_t> &pClipCodes, std::true_type) const
+	{
+		ShadeVertexBatches(m_vertex_shader, pVertices, pReferenced, pVertexOut, pClipCodes);
+	}
+
+	void ShadeFragments(const ArenaVector<Fragment> &pFragments, const ArenaVector<Vec2I> &pFragmentIndexes, ArenaVector<Vec4f> &pFragmentOut,
+		const RenderTargetView *pTargets, std::false_type) const
+	{
+		size_t fragment_size = pFragments.size();
+		pFragmentOut.resize(fragment_size * rtv_num);
+
+#ifdef PARALL
+		concurrency::parallel_for(size_t(0), fragment_size, [&](const size_t &i) {
+			Vec4f *curr_fragment_out = pFragmentOut.data() + i * rtv_num;
+			m_fragment_shader(pFragments[i], &curr_fragment_out);
+		});
+#else
+		for (size_t i = 0; i < fragment_size; i++)
+		{
+			Vec4f *curr_fragment_out = pFragmentOut.data() + i * rtv_num;
+			m_fragment_shader(pFragments[i], &curr_fragment_out);
+		}
+#endif // PARALL
+
+		for (size_t i = 0; i < fragment_size; i++)
+		{
+			WriteOutput(pFragmentOut.data() + i * rtv_num, pFragmentIndexes[i], pTargets, std::make_index_sequence<rtv_num>());
+		}
+	}
+
+	void ShadeFragments(const ArenaVector<Fragment> &, const ArenaVector<Vec2I> &, ArenaVector<Vec4f> &, const RenderTargetView *, std::true_type) const
+	{
+		throw std::exception("Error: pipeline state shades packets");
+	}
+
+	void ShadePackets(const ArenaVector<FragmentPacket> &pPackets, ArenaVector<FragmentPacketOut> &pPacketOut, const RenderTargetView *pTargets, std::true_type) const
+	{
+		size_t packet_size = pPackets.size();
+		pPacketOut.resize(packet_size * rtv_num);
+
+#ifdef PARALL
+		concurrency::parallel_for(size_t(0), packet_size, [&](const size_t &i) {
+			m_fragment_shader(pPackets[i], pPacketOut.data() + i * rtv_num);
+		});
+#else
+		for (size_t i = 0; i < packet_size; i++)
+		{
+			m_fragment_shader(pPackets[i], pPacketOut.data() + i * rtv_num);
+		}
+#endif // PARALL
+
+		for (size_t i = 0; i < packet_size; i++)
+		{
+			const FragmentPacket &packet = pPackets[i];
+			const FragmentPacketOut *out = pPacketOut.data() + i * rtv_num;
+
+			for (int k = 0; k < rowWidth; k++)
+			{
+				if (packet.m_mask & (1 << k))
+				{
+					WritePacketOutput(out, k, Vec2I(packet.m_origin.x + k, packet.m_origin.y), pTargets, std::make_index_sequence<rtv_num>());
+				}
+			}
+		}
+	}
+
+	void ShadePackets(const ArenaVector<FragmentPacket> &, ArenaVector<FragmentPacketOut> &, const RenderTargetView *, std::false_type) const
+	{
+		throw std::exception("Error: pipeline state does not shade packets");
+	}
+
+	template<size_t... Index>
+	void WriteOutput(const Vec4f *pOut, const Vec2I &pIndex, const RenderTargetView *pTargets, std::index_sequence<Index...>) const
+	{
+		int expand[] = { 0, (RenderTargetFormat<RTFormats>::Store(pTargets[Index], pIndex, pOut[Index]), 0)... };
+		(void)expand;
+	}
+
+	template<size_t... Index>
+	void WritePacketOutput(const FragmentPacketOut *pOut, const int &pLane, const Vec2I &pIndex, const RenderTargetView *pTargets, std::index_sequence<Index...>) const
+	{
+		int expand[] = { 0, (RenderTargetFormat<RTFormats>::Store(pTargets[Index], pIndex,
+			Vec4f(pOut[Index].m_value[0][pLane], pOut[Index].m_value[1][pLane], pOut[Index].m_value[2][pLane], pOut[Index].m_value[3][pLane])), 0)... };
+		(void)expand;
+	}
+
+	VS m_vertex_shader;
+	PS m_fragment_shader;
+};
+#endif // !PIPELINE_H
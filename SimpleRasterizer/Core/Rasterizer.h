@@ -4,51 +4,58 @@
 #include "PCH.h"
 #include "Clipper.h"
 #include "Image.h"
+#include "HiZBuffer.h"
+#include "RowEvaluator.h"
+#include <cstdint>
 
 static constexpr int blockSize = 16;
 
-using RasterizerInterpolationFun = std::function<void(const Fragment &pFragment0, const Fragment &pFragment1, const Fragment &pFragment2,
-	const float &t0, const float &t1, const float &t2, Fragment &pDest)>;
+//triangles whose bounding box is smaller than this in both directions skip the block traversal
+static constexpr int smallTriangleSize = blockSize;
 
-inline void BaseRaterFun(const Fragment &pFragment0, const Fragment &pFragment1, const Fragment &pFragment2,
-	const float &t0, const float &t1, const float &t2, Fragment &pDest)
-{
-	pDest.m_pos = pFragment0.m_pos * t0 + pFragment1.m_pos * t1 + pFragment2.m_pos * t2;
-	pDest.m_normal = pFragment0.m_normal * t0 + pFragment1.m_normal * t1 + pFragment2.m_normal * t2;
-	pDest.m_uv = pFragment0.m_uv * t0 + pFragment1.m_uv * t1 + pFragment2.m_uv * t2;
-}
+//raster positions are 24.8 fixed point
+static constexpr int subPixelBits = 8;
+static constexpr int subPixelStep = 1 << subPixelBits;
 
-inline void Extension0RaterFun(const Fragment &pFragment0, const Fragment &pFragment1, const Fragment &pFragment2,
-	const float &t0, const float &t1, const float &t2, Fragment &pDest)
-{
-	pDest.m_pos = pFragment0.m_pos * t0 + pFragment1.m_pos * t1 + pFragment2.m_pos * t2;
-	pDest.m_normal = pFragment0.m_normal * t0 + pFragment1.m_normal * t1 + pFragment2.m_normal * t2;
-	pDest.m_uv = pFragment0.m_uv * t0 + pFragment1.m_uv * t1 + pFragment2.m_uv * t2;
-	pDest.pack0 = pFragment0.pack0 * t0 + pFragment1.pack0 * t1 + pFragment2.pack0 * t2;
-}
+//keeps edge values of 24.8 positions below 2^51 with vertices anywhere inside the guard band
+static constexpr float maxViewportSize = 16384.0f;
+
+//interpolated depth can round slightly below the nearest vertex, hi-z rejection keeps this much margin
+static constexpr float hiZEpsilon = 1e-5f;
 
-inline void Extension1RaterFun(const Fragment &pFragment0, const Fragment &pFragment1, const Fragment &pFragment2,
-	const float &t0, const float &t1, const float &t2, Fragment &pDest)
+//twice the signed area of the triangle in fixed point, positive when it covers pixels
+inline int64_t TriangleArea(const Vec2I &p0, const Vec2I &p1, const Vec2I &p2)
 {
-	pDest.m_pos = pFragment0.m_pos * t0 + pFragment1.m_pos * t1 + pFragment2.m_pos * t2;
-	pDest.m_normal = pFragment0.m_normal * t0 + pFragment1.m_normal * t1 + pFragment2.m_normal * t2;
-	pDest.m_uv = pFragment0.m_uv * t0 + pFragment1.m_uv * t1 + pFragment2.m_uv * t2;
-	pDest.pack0 = pFragment0.pack0 * t0 + pFragment1.pack0 * t1 + pFragment2.pack0 * t2;
-	pDest.pack1 = pFragment0.pack1 * t0 + pFragment1.pack1 * t1 + pFragment2.pack1 * t2;
+	return int64_t(p0.y - p1.y) * (p2.x - p0.x) + int64_t(p1.x - p0.x) * (p2.y - p0.y);
 }
 
+//p0 and p1 are fixed point raster positions, p is a pixel, the edge is sampled at its center.
+//i and j step a whole pixel
 struct EdgeEquation
 {
-	int i, j, k, value;
+	int64_t i, j, value;
 
 	EdgeEquation() {};
 
 	EdgeEquation(const Vec2I &p0, const Vec2I &p1, const Vec2I &p)
 	{
-		i = p0.y - p1.y;
-		j = p1.x - p0.x;
-		k = p0.x * p1.y - p0.y * p1.x;
-		value = p.x * i + p.y * j + k;
+		int64_t a = p0.y - p1.y;
+		int64_t b = p1.x - p0.x;
+
+		int64_t sample_x = (int64_t(p.x) << subPixelBits) + subPixelStep / 2;
+		int64_t sample_y = (int64_t(p.y) << subPixelBits) + subPixelStep / 2;
+		value = a * (sample_x - p0.x) + b * (sample_y - p0.y);
+
+		//top left rule: a pixel center exactly on the edge belongs to the triangle only if it is a top or a left edge,
+		//so a pixel on an edge shared by two triangles is drawn once
+		bool top_left = a > 0 || (a == 0 && b > 0);
+		if (!top_left)
+		{
+			value -= 1;
+		}
+
+		i = a << subPixelBits;
+		j = b << subPixelBits;
 	}
 
 	void incrementX(const int &step = 1)
@@ -60,6 +67,17 @@ struct EdgeEquation
 	{
 		value += step * j;
 	}
+
+	//from the block origin to the pixels of a blockSize * blockSize block where the edge function is largest and smallest
+	int64_t maxBlockOffset() const
+	{
+		return (max(i, int64_t(0)) + max(j, int64_t(0))) * (blockSize - 1);
+	}
+
+	int64_t minBlockOffset() const
+	{
+		return (min(i, int64_t(0)) + min(j, int64_t(0))) * (blockSize - 1);
+	}
 };
 
 struct EdgeEquationSet
@@ -95,249 +113,719 @@ struct EdgeEquationSet
 	}
 };
 
-inline void RenderInsideBlock(const RasterizerInterpolationFun &pFun, const Triangle &pTriangle, const float (&pInvCamZ)[3], const EdgeEquationSet &pSet, const int &pArea, const int &pX, const int &pY,
-	std::shared_ptr<ExtensionImage<float>> pDepthBuffer, std::vector<Fragment> &pFragments, std::vector<Vec2I> &pFragmentIndexes)
+//the floats of a fragment, planes are indexed by the float of Fragment they interpolate.
+//the planes of m_pos.z and m_pos.w hold z and 1 / w, the ones of the varyings hold the varying divided by w
+static constexpr size_t fragmentFloatNum = sizeof(Fragment) / sizeof(float);
+static constexpr size_t zPlane = 2;
+static constexpr size_t invCameraZPlane = 3;
+
+//a value that is linear in screen space, m_value is at the center of the pixel the plane is set up around,
+//m_dx and m_dy step one pixel
+struct Plane
 {
-	EdgeEquationSet blockYSet = pSet;
-	EdgeEquationSet blockXSet;
+	float m_value;
+	float m_dx;
+	float m_dy;
+};
+
+//triangle after raster space setup, shared by every tile it is binned into
+//the vertices point into the projected vertex array of the current draw, the planes are set up around m_box_min
+struct RasterTriangle
+{
+	const Fragment *m_vertex[3];
+	Vec2I m_raster_pos[3];
+	float m_inv_camera_z[3];
+	float m_min_z;
+	Vec2I m_box_min;
+	Vec2I m_box_max;
+	int64_t m_area;
+	Plane m_z_plane;
+	Plane m_inv_camera_z_plane;
+};
 
-	int y_end = pY + blockSize;
-	int x_end = pX + blockSize;
+//screen space barycentric coordinates of a set up triangle around the center of pixel pOrigin. they are kept in double,
+//far from a sliver its coordinates grow large and the planes built from them would lose their precision in float
+struct BarycentricPlanes
+{
+	double m_value[3];
+	double m_dx[3];
+	double m_dy[3];
 
-	for (int y = pY; y < y_end; y++)
+	BarycentricPlanes(const Vec2I *pRasterPos, const int64_t &pArea, const Vec2I &pOrigin)
 	{
-		blockXSet = blockYSet;
-		for (int x = pX; x < x_end; x++)
+		double inv_area = 1.0 / static_cast<double>(pArea);
+
+		int64_t sample_x = (int64_t(pOrigin.x) << subPixelBits) + subPixelStep / 2;
+		int64_t sample_y = (int64_t(pOrigin.y) << subPixelBits) + subPixelStep / 2;
+
+		for (size_t i = 0; i < 3; i++)
 		{
-			float param0 = pInvCamZ[0] * blockXSet.e0.value;
-			float param1 = pInvCamZ[1] * blockXSet.e1.value;
-			float param2 = pInvCamZ[2] * blockXSet.e2.value;
+			//the edge opposite vertex i, like in EdgeEquationSet but without the top left bias
+			const Vec2I &p0 = pRasterPos[(i + 1) % 3];
+			const Vec2I &p1 = pRasterPos[(i + 2) % 3];
 
-			float curr_camera_z = 1 / (param0 + param1 + param2);
-			float curr_ndc_z = curr_camera_z * (pTriangle.m_vertex[0].m_pos.z * param0 +
-				pTriangle.m_vertex[1].m_pos.z * param1 +
-				pTriangle.m_vertex[2].m_pos.z * param2);
+			int64_t a = p0.y - p1.y;
+			int64_t b = p1.x - p0.x;
 
-			if (curr_ndc_z < pDepthBuffer->GetPixel(x, y))
-			{
-				pDepthBuffer->SetPixel(curr_ndc_z, x, y);
+			m_value[i] = static_cast<double>(a * (sample_x - p0.x) + b * (sample_y - p0.y)) * inv_area;
+			m_dx[i] = static_cast<double>(a << subPixelBits) * inv_area;
+			m_dy[i] = static_cast<double>(b << subPixelBits) * inv_area;
+		}
+	}
 
-				Fragment curr_fragment_in;
+	Plane GetPlane(const double &q0, const double &q1, const double &q2) const
+	{
+		Plane plane;
+		plane.m_value = static_cast<float>(q0 * m_value[0] + q1 * m_value[1] + q2 * m_value[2]);
+		plane.m_dx = static_cast<float>(q0 * m_dx[0] + q1 * m_dx[1] + q2 * m_dx[2]);
+		plane.m_dy = static_cast<float>(q0 * m_dy[0] + q1 * m_dy[1] + q2 * m_dy[2]);
+		return plane;
+	}
+};
 
-				pFun(pTriangle.m_vertex[0], pTriangle.m_vertex[1], pTriangle.m_vertex[2],
-					param0 * curr_camera_z, param1 * curr_camera_z, param2 * curr_camera_z,
-					curr_fragment_in);
+//values of the planes at one pixel
+struct PlaneValues
+{
+	float m_value[fragmentFloatNum];
+};
 
-				pFragments.emplace_back(curr_fragment_in);
-				pFragmentIndexes.emplace_back(Vec2I(x, y));
-			}
-			blockXSet.incrementX();
-		}
-		blockYSet.incrementY();
+//planes of a triangle in one tile, the floats of Fragment outside the varyings stay zero
+struct FragmentPlanes
+{
+	PlaneValues m_origin;
+	PlaneValues m_dx;
+	PlaneValues m_dy;
+	PlaneValues m_row_dx;
+};
+
+//the pixels of one row group in structure of arrays form, lane k is pixel m_origin.x + k of row m_origin.y.
+//m_value is indexed by the float of Fragment like the planes, only the position and the varyings are written.
+//lanes not set in m_mask hold no fragment
+struct FragmentPacket
+{
+	FragmentPacket() {};
+
+	alignas(32) float m_value[fragmentFloatNum][rowWidth];
+	Vec2I m_origin;
+	int m_mask;
+};
+
+//what a packet shader writes to one render target, m_value[c][k] is channel c of lane k
+struct FragmentPacketOut
+{
+	alignas(32) float m_value[4][rowWidth];
+};
+
+inline void SetPlane(const size_t &pIndex, const Plane &pPlane, FragmentPlanes &pPlanes)
+{
+	pPlanes.m_origin.m_value[pIndex] = pPlane.m_value;
+	pPlanes.m_dx.m_value[pIndex] = pPlane.m_dx;
+	pPlanes.m_dy.m_value[pIndex] = pPlane.m_dy;
+	pPlanes.m_row_dx.m_value[pIndex] = pPlane.m_dx * rowWidth;
+}
+
+//x and y are linear in screen space, z and 1 / w were set up with the triangle
+inline void SetupPositionPlanes(const RasterTriangle &pTriangle, const BarycentricPlanes &pBarycentric, FragmentPlanes &pPlanes)
+{
+	const Fragment *const *vertex = pTriangle.m_vertex;
+
+	SetPlane(0, pBarycentric.GetPlane(vertex[0]->m_pos.x, vertex[1]->m_pos.x, vertex[2]->m_pos.x), pPlanes);
+	SetPlane(1, pBarycentric.GetPlane(vertex[0]->m_pos.y, vertex[1]->m_pos.y, vertex[2]->m_pos.y), pPlanes);
+	SetPlane(zPlane, pTriangle.m_z_plane, pPlanes);
+	SetPlane(invCameraZPlane, pTriangle.m_inv_camera_z_plane, pPlanes);
+}
+
+//varyings are divided by w, so they are linear in screen space as well
+inline void SetupVaryingPlanes(const RasterTriangle &pTriangle, const BarycentricPlanes &pBarycentric, const size_t &pOffset, const size_t &pSize, FragmentPlanes &pPlanes)
+{
+	const float *data0 = FragmentData(*pTriangle.m_vertex[0]);
+	const float *data1 = FragmentData(*pTriangle.m_vertex[1]);
+	const float *data2 = FragmentData(*pTriangle.m_vertex[2]);
+
+	for (size_t i = pOffset; i < pOffset + pSize; i++)
+	{
+		SetPlane(i, pBarycentric.GetPlane(double(data0[i]) * pTriangle.m_inv_camera_z[0], double(data1[i]) * pTriangle.m_inv_camera_z[1],
+			double(data2[i]) * pTriangle.m_inv_camera_z[2]), pPlanes);
 	}
 }
 
-inline void RenderIntersectBlock(const RasterizerInterpolationFun &pFun, const Triangle &pTriangle, const float(&pInvCamZ)[3], const EdgeEquationSet &pSet, 
-	const int &pArea, const int &pX, const int &pY, const Vec2I &pMaxPos, std::shared_ptr<ExtensionImage<float>> pDepthBuffer, 
-	std::vector<Fragment> &pFragments, std::vector<Vec2I> &pFragmentIndexes)
+//pX and pY are relative to the plane origin
+inline void EvaluatePlanes(const FragmentPlanes &pPlanes, const float &pX, const float &pY, const size_t &pOffset, const size_t &pSize, PlaneValues &pValue)
 {
-	EdgeEquationSet blockYSet = pSet;
-	EdgeEquationSet blockXSet;
+	for (size_t i = pOffset; i < pOffset + pSize; i++)
+	{
+		pValue.m_value[i] = pPlanes.m_origin.m_value[i] + pPlanes.m_dx.m_value[i] * pX + pPlanes.m_dy.m_value[i] * pY;
+	}
+}
 
-	int y_end = pY + blockSize;
-	int x_end = pX + blockSize;
+inline void StepPlanes(PlaneValues &pValue, const PlaneValues &pStep, const size_t &pOffset, const size_t &pSize)
+{
+	for (size_t i = pOffset; i < pOffset + pSize; i++)
+	{
+		pValue.m_value[i] += pStep.m_value[i];
+	}
+}
 
-	for (int y = pY; y < y_end; y++)
+inline void EmitVarying(const PlaneValues &pValue, const float &pCameraZ, const size_t &pOffset, const size_t &pSize, float *pDest)
+{
+	for (size_t i = pOffset; i < pOffset + pSize; i++)
+	{
+		pDest[i] = pValue.m_value[i] * pCameraZ;
+	}
+}
+
+//lane k is k steps of pStep away from pValue, every lane is computed from pValue so the loops vectorize
+inline void EmitPacketPosition(const PlaneValues &pValue, const PlaneValues &pStep, FragmentPacket &pDest)
+{
+	for (size_t i = 0; i < 3; i++)
 	{
-		blockXSet = blockYSet;
-		for (int x = pX; x < x_end; x++)
+		for (int k = 0; k < rowWidth; k++)
 		{
-			if (blockXSet.evaluate())
-			{
-				float param0 = pInvCamZ[0] * blockXSet.e0.value;
-				float param1 = pInvCamZ[1] * blockXSet.e1.value;
-				float param2 = pInvCamZ[2] * blockXSet.e2.value;
+			pDest.m_value[i][k] = pValue.m_value[i] + static_cast<float>(k) * pStep.m_value[i];
+		}
+	}
 
-				float curr_camera_z = 1 / (param0 + param1 + param2);
-				float curr_ndc_z = curr_camera_z * (pTriangle.m_vertex[0].m_pos.z * param0 +
-					pTriangle.m_vertex[1].m_pos.z * param1 +
-					pTriangle.m_vertex[2].m_pos.z * param2);
+	for (int k = 0; k < rowWidth; k++)
+	{
+		pDest.m_value[invCameraZPlane][k] = 1.0f;
+	}
+}
 
-				if (curr_ndc_z < pDepthBuffer->GetPixel(x, y))
-				{
-					pDepthBuffer->SetPixel(curr_ndc_z, x, y);
+inline void EmitPacketVarying(const PlaneValues &pValue, const PlaneValues &pStep, const float *pCameraZ, const size_t &pOffset, const size_t &pSize,
+	FragmentPacket &pDest)
+{
+	for (size_t i = pOffset; i < pOffset + pSize; i++)
+	{
+		for (int k = 0; k < rowWidth; k++)
+		{
+			pDest.m_value[i][k] = (pValue.m_value[i] + static_cast<float>(k) * pStep.m_value[i]) * pCameraZ[k];
+		}
+	}
+}
 
-					Fragment curr_fragment_in;
+//set up, evaluate and step the planes of the position and of the varyings, and write a fragment from them.
+//the stateless form for varyings known at compile time, a pipeline passes it so the block loops can inline it
+template<typename Layout>
+struct RasterizerInterpolation;
 
-					pFun(pTriangle.m_vertex[0], pTriangle.m_vertex[1], pTriangle.m_vertex[2],
-						param0 * curr_camera_z, param1 * curr_camera_z, param2 * curr_camera_z,
-						curr_fragment_in);
+template<typename... Attributes>
+struct RasterizerInterpolation<Varyings<Attributes...>>
+{
+	void Setup(const RasterTriangle &pTriangle, FragmentPlanes &pPlanes) const
+	{
+		BarycentricPlanes barycentric(pTriangle.m_raster_pos, pTriangle.m_area, pTriangle.m_box_min);
+		SetupPositionPlanes(pTriangle, barycentric, pPlanes);
 
-					pFragments.emplace_back(curr_fragment_in);
-					pFragmentIndexes.emplace_back(Vec2I(x, y));
-				}
+		int expand[] = { 0, (SetupVaryingPlanes(pTriangle, barycentric, Attributes::offset, Attributes::size, pPlanes), 0)... };
+		(void)expand;
+	}
+
+	void Evaluate(const FragmentPlanes &pPlanes, const int &pX, const int &pY, PlaneValues &pValue) const
+	{
+		float x = static_cast<float>(pX);
+		float y = static_cast<float>(pY);
+		EvaluatePlanes(pPlanes, x, y, 0, 4, pValue);
+
+		int expand[] = { 0, (EvaluatePlanes(pPlanes, x, y, Attributes::offset, Attributes::size, pValue), 0)... };
+		(void)expand;
+	}
+
+	void Step(PlaneValues &pValue, const PlaneValues &pStep) const
+	{
+		StepPlanes(pValue, pStep, 0, 4);
+
+		int expand[] = { 0, (StepPlanes(pValue, pStep, Attributes::offset, Attributes::size), 0)... };
+		(void)expand;
+	}
+
+	void Emit(const PlaneValues &pValue, const float &pCameraZ, Fragment &pDest) const
+	{
+		pDest.m_pos = Vec4f(pValue.m_value[0], pValue.m_value[1], pValue.m_value[zPlane], 1.0f);
+
+		int expand[] = { 0, (EmitVarying(pValue, pCameraZ, Attributes::offset, Attributes::size, FragmentData(pDest)), 0)... };
+		(void)expand;
+	}
+
+	//pValue holds the planes at lane 0, pCameraZ the w of every lane
+	void EmitPacket(const PlaneValues &pValue, const PlaneValues &pStep, const float *pCameraZ, FragmentPacket &pDest) const
+	{
+		EmitPacketPosition(pValue, pStep, pDest);
+
+		int expand[] = { 0, (EmitPacketVarying(pValue, pStep, pCameraZ, Attributes::offset, Attributes::size, pDest), 0)... };
+		(void)expand;
+	}
+};
+
+//a run of consecutive floats of Fragment
+struct FloatRun
+{
+	size_t m_begin;
+	size_t m_end;
+};
+
+//the same for varyings declared at runtime. adjacent varyings are merged into runs,
+//so the usual layouts step one run of floats that starts at the position
+class RasterizerLayoutInterpolation
+{
+public:
+	RasterizerLayoutInterpolation(const VaryingLayout &pLayout = GetVaryingLayout(BaseVaryings()))
+	{
+		bool varying[fragmentFloatNum] = {};
+		for (size_t i = 0; i < pLayout.m_count; i++)
+		{
+			for (size_t k = pLayout.m_offset[i]; k < pLayout.m_offset[i] + pLayout.m_size[i]; k++)
+			{
+				varying[k] = true;
 			}
-			blockXSet.incrementX();
 		}
-		blockYSet.incrementY();
+
+		bool plane[fragmentFloatNum];
+		for (size_t k = 0; k < fragmentFloatNum; k++)
+		{
+			plane[k] = varying[k] || k < 4;
+		}
+
+		m_varying_run_num = GetRuns(varying, m_varying_run);
+		m_plane_run_num = GetRuns(plane, m_plane_run);
 	}
-}
 
-//Ïß¶ÎÏà½»²âÊÔ
-inline bool FasterLineSegmentIntersection(const Vec2I &p1, const Vec2I &p2, const Vec2I &p3, const Vec2I &p4) {
+	void Setup(const RasterTriangle &pTriangle, FragmentPlanes &pPlanes) const
+	{
+		BarycentricPlanes barycentric(pTriangle.m_raster_pos, pTriangle.m_area, pTriangle.m_box_min);
+		SetupPositionPlanes(pTriangle, barycentric, pPlanes);
 
-	Vec2I a = p2 - p1;
-	Vec2I b = p3 - p4;
-	Vec2I c = p1 - p3;
+		for (size_t i = 0; i < m_varying_run_num; i++)
+		{
+			const FloatRun &run = m_varying_run[i];
+			SetupVaryingPlanes(pTriangle, barycentric, run.m_begin, run.m_end - run.m_begin, pPlanes);
+		}
+	}
 
-	int alphaDenominator = a.y*b.x - a.x*b.y;
-	int betaDenominator = alphaDenominator;
+	void Evaluate(const FragmentPlanes &pPlanes, const int &pX, const int &pY, PlaneValues &pValue) const
+	{
+		float x = static_cast<float>(pX);
+		float y = static_cast<float>(pY);
 
-	bool doIntersect = true;
+		for (size_t i = 0; i < m_plane_run_num; i++)
+		{
+			const FloatRun &run = m_plane_run[i];
+			EvaluatePlanes(pPlanes, x, y, run.m_begin, run.m_end - run.m_begin, pValue);
+		}
+	}
 
-	if (alphaDenominator == 0 || betaDenominator == 0) {
-		doIntersect = false;
+	void Step(PlaneValues &pValue, const PlaneValues &pStep) const
+	{
+		for (size_t i = 0; i < m_plane_run_num; i++)
+		{
+			const FloatRun &run = m_plane_run[i];
+			StepPlanes(pValue, pStep, run.m_begin, run.m_end - run.m_begin);
+		}
 	}
-	else {
-		int alphaNumerator = b.y*c.x - b.x*c.y;
 
-		if (alphaDenominator > 0) {
-			if (alphaNumerator < 0 || alphaNumerator > alphaDenominator) {
-				doIntersect = false;
-			}
+	void Emit(const PlaneValues &pValue, const float &pCameraZ, Fragment &pDest) const
+	{
+		pDest.m_pos = Vec4f(pValue.m_value[0], pValue.m_value[1], pValue.m_value[zPlane], 1.0f);
+
+		for (size_t i = 0; i < m_varying_run_num; i++)
+		{
+			const FloatRun &run = m_varying_run[i];
+			EmitVarying(pValue, pCameraZ, run.m_begin, run.m_end - run.m_begin, FragmentData(pDest));
 		}
-		else if (alphaNumerator > 0 || alphaNumerator < alphaDenominator) {
-			doIntersect = false;
+	}
+
+	void EmitPacket(const PlaneValues &pValue, const PlaneValues &pStep, const float *pCameraZ, FragmentPacket &pDest) const
+	{
+		EmitPacketPosition(pValue, pStep, pDest);
+
+		for (size_t i = 0; i < m_varying_run_num; i++)
+		{
+			const FloatRun &run = m_varying_run[i];
+			EmitPacketVarying(pValue, pStep, pCameraZ, run.m_begin, run.m_end - run.m_begin, pDest);
 		}
+	}
 
-		int betaNumerator = a.x*c.y - a.y*c.x;
+private:
+	static size_t GetRuns(const bool *pUsed, FloatRun *pRuns)
+	{
+		size_t run_num = 0;
+		for (size_t k = 0; k < fragmentFloatNum; k++)
+		{
+			if (!pUsed[k])
+			{
+				continue;
+			}
 
-		if (doIntersect && betaDenominator > 0) {
-			if (betaNumerator < 0 || betaNumerator > betaDenominator) {
-				doIntersect = false;
+			if (run_num > 0 && pRuns[run_num - 1].m_end == k)
+			{
+				pRuns[run_num - 1].m_end++;
+			}
+			else
+			{
+				pRuns[run_num++] = { k, k + 1 };
 			}
 		}
-		else if (betaNumerator > 0 || betaNumerator < betaDenominator) {
-			doIntersect = false;
-		}
+		return run_num;
 	}
 
-	return doIntersect;
+	//a float starts a run only after one that is not used, so there are at most half as many runs as floats
+	FloatRun m_varying_run[(fragmentFloatNum + 1) / 2];
+	FloatRun m_plane_run[(fragmentFloatNum + 1) / 2];
+	size_t m_varying_run_num;
+	size_t m_plane_run_num;
+};
+
+//the z and 1 / w steps are left for SetRowPlanes, the small triangle path tests coverage before it sets up any plane
+inline RowTriangle GetRowTriangle(const EdgeEquationSet &pSet)
+{
+	RowTriangle row_triangle;
+	row_triangle.m_step[0] = pSet.e0.i;
+	row_triangle.m_step[1] = pSet.e1.i;
+	row_triangle.m_step[2] = pSet.e2.i;
+	row_triangle.m_z_step = 0.0f;
+	row_triangle.m_inv_camera_z_step = 0.0f;
+	return row_triangle;
+}
+
+inline void SetRowPlanes(const FragmentPlanes &pPlanes, RowTriangle &pRowTriangle)
+{
+	pRowTriangle.m_z_step = pPlanes.m_dx.m_value[zPlane];
+	pRowTriangle.m_inv_camera_z_step = pPlanes.m_dx.m_value[invCameraZPlane];
 }
 
-//Ïß¶ÎÈý½ÇÐÎÏà½»²âÊÔ
-inline bool SegmentTriangleIntersection(const Vec2I &p0, const Vec2I &p1, const Vec2I &v0, const Vec2I &v1, const Vec2I &v2)
+//the block loops hand every evaluated row group to a writer, pMask marks the pixels that passed starting at pixel pX
+//and pValue holds the planes at pX.
+//one fragment and its position per pixel, the planes are stepped one pixel at a time
+struct FragmentWriter
 {
-	if (FasterLineSegmentIntersection(p0, p1, v0, v1) ||
-		FasterLineSegmentIntersection(p0, p1, v1, v2) ||
-		FasterLineSegmentIntersection(p0, p1, v2, v0))
+	ArenaVector<Fragment> &m_fragments;
+	ArenaVector<Vec2I> &m_fragment_indexes;
+
+	template<typename InterpolationFun>
+	void Write(const InterpolationFun &pFun, const FragmentPlanes &pPlanes, int pMask, const PlaneValues &pValue, const float *pCameraZ,
+		const int &pX, const int &pY)
 	{
-		return true;
+		PlaneValues value = pValue;
+
+		for (int k = 0; pMask != 0; k++, pMask >>= 1)
+		{
+			if (pMask & 1)
+			{
+				m_fragments.emplace_back();
+				pFun.Emit(value, pCameraZ[k], m_fragments.back());
+				m_fragment_indexes.emplace_back(Vec2I(pX + k, pY));
+			}
+
+			pFun.Step(value, pPlanes.m_dx);
+		}
 	}
+};
 
-	return false;
+//one packet per row group with a pixel left
+struct PacketWriter
+{
+	ArenaVector<FragmentPacket> &m_packets;
+
+	template<typename InterpolationFun>
+	void Write(const InterpolationFun &pFun, const FragmentPlanes &pPlanes, int pMask, const PlaneValues &pValue, const float *pCameraZ,
+		const int &pX, const int &pY)
+	{
+		if (pMask == 0)
+		{
+			return;
+		}
+
+		m_packets.emplace_back();
+		FragmentPacket &packet = m_packets.back();
+		packet.m_origin = Vec2I(pX, pY);
+		packet.m_mask = pMask;
+		pFun.EmitPacket(pValue, pPlanes.m_dx, pCameraZ, packet);
+	}
+};
+
+//renders [pX, pXEnd) of row pY rowWidth pixels at a time, row groups are written in x order. pValue holds the planes at pX
+template<typename InterpolationFun, typename Writer>
+inline void RenderBlockRow(const InterpolationFun &pFun, const RowEvalFun &pRowEval, const RowTriangle &pRowTriangle, const FragmentPlanes &pPlanes,
+	const EdgeEquationSet &pSet, const PlaneValues &pValue, const bool &pTestCoverage, const int &pX, const int &pXEnd, const int &pY,
+	const std::shared_ptr<ExtensionImage<float>> &pDepthBuffer, Writer &pWriter)
+{
+	float *depth_row = &pDepthBuffer->GetPixel(pX, pY);
+
+	int64_t edge[3] = { pSet.e0.value, pSet.e1.value, pSet.e2.value };
+	PlaneValues value = pValue;
+	float camera_z[rowWidth] = {};
+
+	for (int x = pX; x < pXEnd; x += rowWidth)
+	{
+		int count = min(rowWidth, pXEnd - x);
+
+		const float &z = value.m_value[zPlane];
+		const float &inv_camera_z = value.m_value[invCameraZPlane];
+
+		//a group cut by the viewport border is evaluated by the scalar path
+		int mask = 0;
+		if (count == rowWidth)
+		{
+			mask = pRowEval(pRowTriangle, edge, z, inv_camera_z, pTestCoverage, depth_row + (x - pX), camera_z);
+		}
+		else
+		{
+			mask = EvaluateRowScalar(pRowTriangle, edge, count, z, inv_camera_z, pTestCoverage, depth_row + (x - pX), camera_z);
+		}
+
+		pWriter.Write(pFun, pPlanes, mask, value, camera_z, x, pY);
+
+		edge[0] += rowWidth * pRowTriangle.m_step[0];
+		edge[1] += rowWidth * pRowTriangle.m_step[1];
+		edge[2] += rowWidth * pRowTriangle.m_step[2];
+		pFun.Step(value, pPlanes.m_row_dx);
+	}
 }
 
-//blockÏß¶ÎÓëÈý½ÇÐÎÏß¶ÎÏà½»²âÊÔ
-inline bool BlockTriangleSegmentIntersection(const Vec2I &ltCorner, const int &blockWidth, const int &blockHeight, const Vec2I &v0, const Vec2I &v1, const Vec2I &v2)
+//pValue holds the planes at the block origin. returns the farthest depth left in the block
+template<typename InterpolationFun, typename Writer>
+inline float RenderInsideBlock(const InterpolationFun &pFun, const RowEvalFun &pRowEval, const RowTriangle &pRowTriangle, const FragmentPlanes &pPlanes,
+	const EdgeEquationSet &pSet, const PlaneValues &pValue, const int &pX, const int &pY, const Vec2I &pMaxPos,
+	const std::shared_ptr<ExtensionImage<float>> &pDepthBuffer, Writer &pWriter)
 {
-	Vec2I rtCorner(ltCorner.x + blockWidth, ltCorner.y);
-	Vec2I lbCorner(ltCorner.x, ltCorner.y + blockHeight);
-	Vec2I rbCorner(ltCorner.x + blockWidth, ltCorner.y + blockHeight);
+	EdgeEquationSet blockYSet = pSet;
+	PlaneValues row_value = pValue;
 
-	if (SegmentTriangleIntersection(lbCorner, rbCorner, v0, v1, v2) ||
-		SegmentTriangleIntersection(lbCorner, ltCorner, v0, v1, v2) ||
-		SegmentTriangleIntersection(ltCorner, rtCorner, v0, v1, v2) ||
-		SegmentTriangleIntersection(rtCorner, rbCorner, v0, v1, v2))
+	float block_max_z = 0.0f;
+
+	int y_end = min(pY + blockSize, pMaxPos.y + 1);
+	int x_end = min(pX + blockSize, pMaxPos.x + 1);
+
+	for (int y = pY; y < y_end; y++)
 	{
-		return true;
+		RenderBlockRow(pFun, pRowEval, pRowTriangle, pPlanes, blockYSet, row_value, false, pX, x_end, y, pDepthBuffer, pWriter);
+
+		const float *depth_row = &pDepthBuffer->GetPixel(pX, y);
+		for (int x = 0; x < x_end - pX; x++)
+		{
+			block_max_z = max(block_max_z, depth_row[x]);
+		}
+
+		blockYSet.incrementY();
+		pFun.Step(row_value, pPlanes.m_dy);
 	}
 
-	return false;
+	return block_max_z;
 }
 
+template<typename InterpolationFun, typename Writer>
+inline void RenderIntersectBlock(const InterpolationFun &pFun, const RowEvalFun &pRowEval, const RowTriangle &pRowTriangle, const FragmentPlanes &pPlanes,
+	const EdgeEquationSet &pSet, const PlaneValues &pValue, const int &pX, const int &pY, const Vec2I &pMaxPos,
+	const std::shared_ptr<ExtensionImage<float>> &pDepthBuffer, Writer &pWriter)
+{
+	EdgeEquationSet blockYSet = pSet;
+	PlaneValues row_value = pValue;
+
+	int y_end = min(pY + blockSize, pMaxPos.y + 1);
+	int x_end = min(pX + blockSize, pMaxPos.x + 1);
+
+	for (int y = pY; y < y_end; y++)
+	{
+		RenderBlockRow(pFun, pRowEval, pRowTriangle, pPlanes, blockYSet, row_value, true, pX, x_end, y, pDepthBuffer, pWriter);
+		blockYSet.incrementY();
+		pFun.Step(row_value, pPlanes.m_dy);
+	}
+}
 
 class Rasterizer
 {
 public:
 	Rasterizer() 
 	{
-		m_inter_fun = BaseRaterFun;
+		m_row_eval_fun = SelectRowEvalFun();
+		m_row_coverage_fun = SelectRowCoverageFun();
+		m_cull_mode = CULL_MODE::BACK;
 	};
 	~Rasterizer() {};
 
 	void SetViewport(const Viewport &pViewport)
 	{
+		if (pViewport.m_width > maxViewportSize || pViewport.m_height > maxViewportSize)
+		{
+			throw std::exception("Error: Viewport is too large");
+		}
+
 		m_viewport = pViewport;
 	}
 
+	void SetCullMode(const CULL_MODE &pMode)
+	{
+		m_cull_mode = pMode;
+	}
+
 	void SetFragmentLayout(const FragmentLayout &layout)
 	{
 		switch (layout)
 		{
 		case FragmentLayout::BASE:
-			m_inter_fun = BaseRaterFun;
+			m_inter_fun = RasterizerLayoutInterpolation(GetVaryingLayout(BaseVaryings()));
 			break;
 		case FragmentLayout::EXTENSION0:
-			m_inter_fun = Extension0RaterFun;
+			m_inter_fun = RasterizerLayoutInterpolation(GetVaryingLayout(Extension0Varyings()));
 			break;
 		case FragmentLayout::EXTENSION1:
-			m_inter_fun = Extension1RaterFun;
+			m_inter_fun = RasterizerLayoutInterpolation(GetVaryingLayout(Extension1Varyings()));
 			break;
 		default:
 			break;
 		}
 	}
 
-	void Rasterize(Triangle &pTriangle, std::vector<Fragment> &pFragments,
-		std::vector<Vec2I> &pFragmentIndexes, std::shared_ptr<ExtensionImage<float>> pDepthBuffer)
+	void SetVaryingLayout(const VaryingLayout &pLayout)
 	{
-		float inv_camera_z[3];
-		inv_camera_z[0] = 1 / pTriangle.m_vertex[0].m_pos.w;
-		inv_camera_z[1] = 1 / pTriangle.m_vertex[1].m_pos.w;
-		inv_camera_z[2] = 1 / pTriangle.m_vertex[2].m_pos.w;
+		m_inter_fun = RasterizerLayoutInterpolation(pLayout);
+	}
 
-		pTriangle.m_vertex[0].m_pos *= inv_camera_z[0];
-		pTriangle.m_vertex[1].m_pos *= inv_camera_z[1];
-		pTriangle.m_vertex[2].m_pos *= inv_camera_z[2];
+	//perspective division, 1 / w is kept for perspective corrected interpolation
+	void ProjectVertex(Fragment &pVertex, float &pInvCameraZ) const
+	{
+		pInvCameraZ = 1 / pVertex.m_pos.w;
+		pVertex.m_pos *= pInvCameraZ;
+	}
 
-		Vec2I raster_pos[3];
-		raster_pos[0] = NDCSpaceToRasterSpace(pTriangle.m_vertex[0].m_pos, m_viewport.m_width, m_viewport.m_height);
-		raster_pos[1] = NDCSpaceToRasterSpace(pTriangle.m_vertex[1].m_pos, m_viewport.m_width, m_viewport.m_height);
-		raster_pos[2] = NDCSpaceToRasterSpace(pTriangle.m_vertex[2].m_pos, m_viewport.m_width, m_viewport.m_height);
+	//pVertices must already be divided by w, pInvCameraZ holds 1 / w of every vertex
+	bool SetupTriangle(const IndexedTriangle &pTriangle, const ArenaVector<Fragment> &pVertices, const ArenaVector<float> &pInvCameraZ, RasterTriangle &pSetup)
+	{
+		for (size_t i = 0; i < 3; i++)
+		{
+			size_t index = pTriangle.m_vertex[i];
+			pSetup.m_vertex[i] = &pVertices[index];
+			pSetup.m_inv_camera_z[i] = pInvCameraZ[index];
+			pSetup.m_raster_pos[i] = NDCSpaceToRasterSpace(pVertices[index].m_pos, m_viewport.m_width, m_viewport.m_height);
+		}
 
-		Vec2I box_min, box_max;
-		box_min.x = static_cast<int>(max(min(min(raster_pos[0].x, raster_pos[1].x), raster_pos[2].x), m_viewport.m_top_leftx));
-		box_min.y = static_cast<int>(max(min(min(raster_pos[0].y, raster_pos[1].y), raster_pos[2].y), m_viewport.m_top_lefty));
+		pSetup.m_min_z = min(min(pVertices[pTriangle.m_vertex[0]].m_pos.z, pVertices[pTriangle.m_vertex[1]].m_pos.z), pVertices[pTriangle.m_vertex[2]].m_pos.z);
+
+		const Vec2I *raster_pos = pSetup.m_raster_pos;
 
-		Vec2I max_raster_pos = Vec2I(m_viewport.m_width - m_viewport.m_top_leftx - 1, m_viewport.m_height - m_viewport.m_top_lefty - 1);
-		box_max.x = static_cast<int>(min(max(max(raster_pos[0].x, raster_pos[1].x), raster_pos[2].x), max_raster_pos.x));
-		box_max.y = static_cast<int>(min(max(max(raster_pos[0].y, raster_pos[1].y), raster_pos[2].y), max_raster_pos.y));
+		Vec2I max_raster_pos = GetMaxRasterPos();
 
-		if (box_min.x >= box_max.x || box_min.y >= box_max.y)
+		//pixels whose center can lie inside the triangle
+		Vec2I &box_min = pSetup.m_box_min;
+		Vec2I &box_max = pSetup.m_box_max;
+		box_min.x = static_cast<int>(max(min(min(raster_pos[0].x, raster_pos[1].x), raster_pos[2].x) >> subPixelBits, m_viewport.m_top_leftx));
+		box_min.y = static_cast<int>(max(min(min(raster_pos[0].y, raster_pos[1].y), raster_pos[2].y) >> subPixelBits, m_viewport.m_top_lefty));
+		box_max.x = static_cast<int>(min(max(max(raster_pos[0].x, raster_pos[1].x), raster_pos[2].x) >> subPixelBits, max_raster_pos.x));
+		box_max.y = static_cast<int>(min(max(max(raster_pos[0].y, raster_pos[1].y), raster_pos[2].y) >> subPixelBits, max_raster_pos.y));
+
+		if (box_min.x > box_max.x || box_min.y > box_max.y)
 		{
-			return;
+			return false;
 		}
 
-		auto notBlockSize = ~(blockSize - 1);
+		pSetup.m_area = TriangleArea(raster_pos[0], raster_pos[1], raster_pos[2]);
 
-		box_min.x = box_min.x & notBlockSize;
-		box_min.y = box_min.y & notBlockSize;
+		if (pSetup.m_area == 0)
+		{
+			return false;
+		}
 
-		box_max.x = box_max.x & notBlockSize;
-		box_max.y = box_max.y & notBlockSize;
+		//the culling before clipping can not decide triangles crossing w = 0, so the winding is checked again here
+		bool front = pSetup.m_area > 0;
+		if ((front && m_cull_mode == CULL_MODE::FRONT) || (!front && m_cull_mode == CULL_MODE::BACK))
+		{
+			return false;
+		}
 
-		Vec2I p(box_min.x, box_min.y);
+		//edge functions are positive inside clockwise triangles only
+		if (!front)
+		{
+			std::swap(pSetup.m_vertex[1], pSetup.m_vertex[2]);
+			std::swap(pSetup.m_inv_camera_z[1], pSetup.m_inv_camera_z[2]);
+			std::swap(pSetup.m_raster_pos[1], pSetup.m_raster_pos[2]);
+			pSetup.m_area = -pSetup.m_area;
+		}
+
+		BarycentricPlanes barycentric(pSetup.m_raster_pos, pSetup.m_area, box_min);
+		pSetup.m_z_plane = barycentric.GetPlane(pSetup.m_vertex[0]->m_pos.z, pSetup.m_vertex[1]->m_pos.z, pSetup.m_vertex[2]->m_pos.z);
+		pSetup.m_inv_camera_z_plane = barycentric.GetPlane(pSetup.m_inv_camera_z[0], pSetup.m_inv_camera_z[1], pSetup.m_inv_camera_z[2]);
+
+		return true;
+	}
+
+	//rasterize the part of a set up triangle that lies inside [pTileMin, pTileMax], pTileMin must be block aligned
+	void Rasterize(const RasterTriangle &pSetup, const Vec2I &pTileMin, const Vec2I &pTileMax, ArenaVector<Fragment> &pFragments,
+		ArenaVector<Vec2I> &pFragmentIndexes, const std::shared_ptr<ExtensionImage<float>> &pDepthBuffer, HiZBuffer &pHiZBuffer)
+	{
+		Rasterize(pSetup, pTileMin, pTileMax, pFragments, pFragmentIndexes, pDepthBuffer, pHiZBuffer, m_inter_fun);
+	}
 
-		EdgeEquation tiangle_equation(raster_pos[0], raster_pos[1], raster_pos[2]);
+	template<typename InterpolationFun>
+	void Rasterize(const RasterTriangle &pSetup, const Vec2I &pTileMin, const Vec2I &pTileMax, ArenaVector<Fragment> &pFragments,
+		ArenaVector<Vec2I> &pFragmentIndexes, const std::shared_ptr<ExtensionImage<float>> &pDepthBuffer, HiZBuffer &pHiZBuffer, const InterpolationFun &pInterFun)
+	{
+		FragmentWriter writer = { pFragments, pFragmentIndexes };
+		RasterizeTriangle(pSetup, pTileMin, pTileMax, pDepthBuffer, pHiZBuffer, pInterFun, writer);
+	}
+
+	//the same with the pixels written as packets of rowWidth lanes
+	void RasterizePackets(const RasterTriangle &pSetup, const Vec2I &pTileMin, const Vec2I &pTileMax, ArenaVector<FragmentPacket> &pPackets,
+		const std::shared_ptr<ExtensionImage<float>> &pDepthBuffer, HiZBuffer &pHiZBuffer)
+	{
+		RasterizePackets(pSetup, pTileMin, pTileMax, pPackets, pDepthBuffer, pHiZBuffer, m_inter_fun);
+	}
 
-		if (tiangle_equation.value <= 0) 
+	template<typename InterpolationFun>
+	void RasterizePackets(const RasterTriangle &pSetup, const Vec2I &pTileMin, const Vec2I &pTileMax, ArenaVector<FragmentPacket> &pPackets,
+		const std::shared_ptr<ExtensionImage<float>> &pDepthBuffer, HiZBuffer &pHiZBuffer, const InterpolationFun &pInterFun)
+	{
+		PacketWriter writer = { pPackets };
+		RasterizeTriangle(pSetup, pTileMin, pTileMax, pDepthBuffer, pHiZBuffer, pInterFun, writer);
+	}
+
+	Vec2I GetMaxRasterPos() const
+	{
+		return Vec2I(static_cast<int>(m_viewport.m_width - m_viewport.m_top_leftx - 1), static_cast<int>(m_viewport.m_height - m_viewport.m_top_lefty - 1));
+	}
+
+private:
+	template<typename InterpolationFun, typename Writer>
+	void RasterizeTriangle(const RasterTriangle &pSetup, const Vec2I &pTileMin, const Vec2I &pTileMax,
+		const std::shared_ptr<ExtensionImage<float>> &pDepthBuffer, HiZBuffer &pHiZBuffer, const InterpolationFun &pInterFun, Writer &pWriter)
+	{
+		const Vec2I *raster_pos = pSetup.m_raster_pos;
+
+		if (pSetup.m_box_max.x - pSetup.m_box_min.x < smallTriangleSize && pSetup.m_box_max.y - pSetup.m_box_min.y < smallTriangleSize)
 		{
+			RasterizeSmallTriangle(pSetup, pTileMin, pTileMax, pDepthBuffer, pHiZBuffer, pInterFun, pWriter);
 			return;
 		}
 
+		auto notBlockSize = ~(blockSize - 1);
+
+		Vec2I box_min, box_max;
+		box_min.x = max(pSetup.m_box_min.x & notBlockSize, pTileMin.x);
+		box_min.y = max(pSetup.m_box_min.y & notBlockSize, pTileMin.y);
+
+		box_max.x = min(pSetup.m_box_max.x, pTileMax.x) & notBlockSize;
+		box_max.y = min(pSetup.m_box_max.y, pTileMax.y) & notBlockSize;
+
+		if (box_min.x > box_max.x || box_min.y > box_max.y)
+		{
+			return;
+		}
+
+		Vec2I max_raster_pos(min(GetMaxRasterPos().x, pTileMax.x), min(GetMaxRasterPos().y, pTileMax.y));
+
+		Vec2I p(box_min.x, box_min.y);
+
 		EdgeEquationSet set(raster_pos[0], raster_pos[1], raster_pos[2], p);
 
+		FragmentPlanes planes = {};
+		pInterFun.Setup(pSetup, planes);
+
+		RowTriangle row_triangle = GetRowTriangle(set);
+		SetRowPlanes(planes, row_triangle);
+
+		//a block is outside when one edge is negative even at its largest pixel,
+		//and inside when every edge is non negative even at its smallest pixel
+		const int64_t reject_offset[3] = { set.e0.maxBlockOffset(), set.e1.maxBlockOffset(), set.e2.maxBlockOffset() };
+		const int64_t accept_offset[3] = { set.e0.minBlockOffset(), set.e1.minBlockOffset(), set.e2.minBlockOffset() };
+
 		EdgeEquationSet setX, setY;
 		setY = set;
 
@@ -346,75 +834,180 @@ public:
 			setX = setY;
 			for (int x = box_min.x; x <= box_max.x; x += blockSize)
 			{
-				EdgeEquationSet temp = setX;
-				EdgeEquationSet leftTopCorner = temp;
-				temp.incrementX(blockSize - 1);
-				EdgeEquationSet rightTopCorner = temp;
-				temp.incrementY(blockSize - 1);
-				EdgeEquationSet rightBottomCorner = temp;
-				temp.incrementX(1 - blockSize);
-				EdgeEquationSet leftBottomCorner = temp;
-
-				bool lb = leftBottomCorner.evaluate();
-				bool lt = leftTopCorner.evaluate();
-				bool rb = rightBottomCorner.evaluate();
-				bool rt = rightTopCorner.evaluate();
-				
+				EdgeEquationSet blockSet = setX;
 				setX.incrementX(blockSize);
 
-				bool inside = lb && lt && rb && rt;
+				bool outside = blockSet.e0.value + reject_offset[0] < 0 ||
+					blockSet.e1.value + reject_offset[1] < 0 ||
+					blockSet.e2.value + reject_offset[2] < 0;
+
+				if (outside)
+				{
+					continue;
+				}
+
+				//the nearest point of the triangle is behind every pixel of the block
+				if (pSetup.m_min_z >= pHiZBuffer.GetBlockMaxZ(x, y) + hiZEpsilon)
+				{
+					continue;
+				}
+
+				bool inside = blockSet.e0.value + accept_offset[0] >= 0 &&
+					blockSet.e1.value + accept_offset[1] >= 0 &&
+					blockSet.e2.value + accept_offset[2] >= 0;
+
+				//the planes start again from the origin at every block, so stepping never runs further than a block
+				PlaneValues block_value;
+				pInterFun.Evaluate(planes, x - pSetup.m_box_min.x, y - pSetup.m_box_min.y, block_value);
 
 				if (inside)
 				{
-					RenderInsideBlock(m_inter_fun, pTriangle, inv_camera_z, leftTopCorner, tiangle_equation.value, x, y, pDepthBuffer, pFragments, pFragmentIndexes);
+					//every pixel of the block was tested, so its farthest depth is known exactly
+					float block_max_z = RenderInsideBlock(pInterFun, m_row_eval_fun, row_triangle, planes, blockSet, block_value, x, y, max_raster_pos,
+						pDepthBuffer, pWriter);
+					pHiZBuffer.SetBlockMaxZ(x, y, block_max_z);
 					continue;
 				}
-				
-				bool intersect = lb || lt || rb || rt;
 
-				if (!intersect)
+				RenderIntersectBlock(pInterFun, m_row_eval_fun, row_triangle, planes, blockSet, block_value, x, y, max_raster_pos,
+					pDepthBuffer, pWriter);
+			}
+			setY.incrementY(blockSize);
+		}
+	}
+
+	//scans the bounding box directly, a coverage pass over all of it comes first so
+	//triangles that contain no pixel center are dropped before any depth or attribute work
+	template<typename InterpolationFun, typename Writer>
+	void RasterizeSmallTriangle(const RasterTriangle &pSetup, const Vec2I &pTileMin, const Vec2I &pTileMax,
+		const std::shared_ptr<ExtensionImage<float>> &pDepthBuffer, HiZBuffer &pHiZBuffer, const InterpolationFun &pInterFun, Writer &pWriter)
+	{
+		static constexpr int groupNum = (smallTriangleSize + rowWidth - 1) / rowWidth;
+
+		const Vec2I *raster_pos = pSetup.m_raster_pos;
+
+		Vec2I box_min(max(pSetup.m_box_min.x, pTileMin.x), max(pSetup.m_box_min.y, pTileMin.y));
+		Vec2I box_max(min(pSetup.m_box_max.x, min(GetMaxRasterPos().x, pTileMax.x)), min(pSetup.m_box_max.y, min(GetMaxRasterPos().y, pTileMax.y)));
+
+		if (box_min.x > box_max.x || box_min.y > box_max.y)
+		{
+			return;
+		}
+
+		EdgeEquationSet set(raster_pos[0], raster_pos[1], raster_pos[2], box_min);
+		RowTriangle row_triangle = GetRowTriangle(set);
+
+		int width = box_max.x - box_min.x + 1;
+		int height = box_max.y - box_min.y + 1;
+
+		int coverage[smallTriangleSize][groupNum];
+		bool covered = false;
+
+		EdgeEquationSet rowSet = set;
+		for (int row = 0; row < height; row++)
+		{
+			int64_t edge[3] = { rowSet.e0.value, rowSet.e1.value, rowSet.e2.value };
+
+			for (int group = 0; group < groupNum; group++)
+			{
+				int count = min(rowWidth, width - group * rowWidth);
+				coverage[row][group] = count > 0 ? m_row_coverage_fun(row_triangle, edge) & ((1 << count) - 1) : 0;
+				covered = covered || coverage[row][group] != 0;
+
+				edge[0] += rowWidth * row_triangle.m_step[0];
+				edge[1] += rowWidth * row_triangle.m_step[1];
+				edge[2] += rowWidth * row_triangle.m_step[2];
+			}
+
+			rowSet.incrementY();
+		}
+
+		if (!covered)
+		{
+			return;
+		}
+
+		//the nearest point of the triangle is behind every block it touches
+		auto notBlockSize = ~(blockSize - 1);
+		bool occluded = true;
+		for (int y = box_min.y & notBlockSize; y <= box_max.y && occluded; y += blockSize)
+		{
+			for (int x = box_min.x & notBlockSize; x <= box_max.x && occluded; x += blockSize)
+			{
+				occluded = pSetup.m_min_z >= pHiZBuffer.GetBlockMaxZ(x, y) + hiZEpsilon;
+			}
+		}
+
+		if (occluded)
+		{
+			return;
+		}
+
+		FragmentPlanes planes = {};
+		pInterFun.Setup(pSetup, planes);
+		SetRowPlanes(planes, row_triangle);
+
+		PlaneValues row_value;
+		pInterFun.Evaluate(planes, box_min.x - pSetup.m_box_min.x, box_min.y - pSetup.m_box_min.y, row_value);
+
+		float camera_z[rowWidth] = {};
+
+		rowSet = set;
+		for (int row = 0; row < height; row++)
+		{
+			int y = box_min.y + row;
+			float *depth_row = &pDepthBuffer->GetPixel(box_min.x, y);
+
+			int64_t edge[3] = { rowSet.e0.value, rowSet.e1.value, rowSet.e2.value };
+			PlaneValues value = row_value;
+
+			for (int group = 0; group < groupNum; group++)
+			{
+				if (coverage[row][group] != 0)
 				{
-					auto pointInsideAABB = [](const Vec2I &min, const Vec2I &max, const Vec2I &point)
-					{
-						return (point.x >= min.x && point.x <= max.x) && (point.y >= min.y && point.y <= max.y);
-					};
-					
-					Vec2I aabbMin(x, y);
-					Vec2I aabbMax(x + blockSize - 1, y + blockSize - 1);
-					if (pointInsideAABB(aabbMin, aabbMax, raster_pos[0]) ||
-						pointInsideAABB(aabbMin, aabbMax, raster_pos[1]) ||
-						pointInsideAABB(aabbMin, aabbMax, raster_pos[2]))
+					int count = min(rowWidth, width - group * rowWidth);
+					float *depth = depth_row + group * rowWidth;
+
+					const float &z = value.m_value[zPlane];
+					const float &inv_camera_z = value.m_value[invCameraZPlane];
+
+					int mask = 0;
+					if (count == rowWidth)
 					{
-						RenderIntersectBlock(m_inter_fun, pTriangle, inv_camera_z, leftTopCorner, tiangle_equation.value, x, y, max_raster_pos, pDepthBuffer, pFragments, pFragmentIndexes);
-						continue;
+						mask = m_row_eval_fun(row_triangle, edge, z, inv_camera_z, true, depth, camera_z);
 					}
-										
-					if (BlockTriangleSegmentIntersection(aabbMin, blockSize - 1, blockSize - 1, 
-						raster_pos[0], raster_pos[1], raster_pos[2]))
+					else
 					{
-						RenderIntersectBlock(m_inter_fun, pTriangle, inv_camera_z, leftTopCorner, tiangle_equation.value, x, y, max_raster_pos, pDepthBuffer, pFragments, pFragmentIndexes);
-						continue;
+						mask = EvaluateRowScalar(row_triangle, edge, count, z, inv_camera_z, true, depth, camera_z);
 					}
-					
-					continue;
+
+					pWriter.Write(pInterFun, planes, mask, value, camera_z, box_min.x + group * rowWidth, y);
 				}
 
-				RenderIntersectBlock(m_inter_fun, pTriangle, inv_camera_z, leftTopCorner, tiangle_equation.value, x, y, max_raster_pos, pDepthBuffer, pFragments, pFragmentIndexes);
+				edge[0] += rowWidth * row_triangle.m_step[0];
+				edge[1] += rowWidth * row_triangle.m_step[1];
+				edge[2] += rowWidth * row_triangle.m_step[2];
+				pInterFun.Step(value, planes.m_row_dx);
 			}
-			setY.incrementY(blockSize);
+
+			rowSet.incrementY();
+			pInterFun.Step(row_value, planes.m_dy);
 		}
 	}
 
-private:
+	//rounds to the nearest fixed point position, so positions moving by less than a pixel still move the edges
 	Vec2I NDCSpaceToRasterSpace(const Vec4f &pPos, const float &pWidth, const float &pHeight)
 	{
 		Vec2I raster_pos;
-		raster_pos.x = static_cast<int>((1 + pPos.x)* 0.5f * pWidth);
-		raster_pos.y = static_cast<int>((1 - pPos.y)* 0.5f * pHeight);
+		raster_pos.x = static_cast<int>(floorf((1 + pPos.x) * 0.5f * pWidth * subPixelStep + 0.5f));
+		raster_pos.y = static_cast<int>(floorf((1 - pPos.y) * 0.5f * pHeight * subPixelStep + 0.5f));
 		return raster_pos;
 	}
 
-	RasterizerInterpolationFun m_inter_fun;
+	RasterizerLayoutInterpolation m_inter_fun;
+	RowEvalFun m_row_eval_fun;
+	RowCoverageFun m_row_coverage_fun;
+	CULL_MODE m_cull_mode;
 	Viewport m_viewport;
 };
 #endif // !RASTERIZER_H
@@ -118,23 +118,52 @@ std::shared_ptr<Buffer> Device3D::CreateBuffer(const BufferDesc &pDesc)
 	return buffer;
 }
 
+std::shared_ptr<Context3D> Device3D::CreateDeferredContext()
+{
+	return std::make_shared<Context3D>(true);
+}
 
-Context3D::Context3D()
+#ifdef PARALL
+Context3D::Context3D(const bool &pDeferred) : m_index_format(INDEX_FORMAT::R32_UINT), m_thread_arenas([]() { return std::make_shared<LinearArena>(); }), m_deferred(pDeferred)
+#else
+Context3D::Context3D(const bool &pDeferred) : m_index_format(INDEX_FORMAT::R32_UINT), m_deferred(pDeferred)
+#endif // PARALL
 {
-	m_clipper = std::make_shared<Clipper>();
-	m_rasterizer = std::make_shared<Rasterizer>();
+	//a deferred context never runs the pipeline itself
+	if (!m_deferred)
+	{
+		m_clipper = std::make_shared<Clipper>();
+		m_rasterizer = std::make_shared<Rasterizer>();
+		m_binner = std::make_shared<Binner>();
+		m_hiz_buffer = std::make_shared<HiZBuffer>(blockSize);
+	}
 }
 
 Context3D::~Context3D()
 {
 	m_clipper = nullptr;
 	m_rasterizer = nullptr;
+	m_binner = nullptr;
+	m_hiz_buffer = nullptr;
+}
+
+bool Context3D::IsDeferred() const
+{
+	return m_deferred;
 }
 
 void Context3D::SetViewport(const Viewport &pViewport)
 {
 	m_viewport = pViewport;
+
+	if (m_deferred)
+	{
+		Record([pViewport](Context3D &pContext) { pContext.SetViewport(pViewport); });
+		return;
+	}
+
 	m_rasterizer->SetViewport(m_viewport);
+	m_binner->SetViewport(m_viewport);
 }
 
 Viewport Context3D::GetViewport()
@@ -144,33 +173,125 @@ Viewport Context3D::GetViewport()
 
 void Context3D::SetFragmentLayout(const FragmentLayout &pLayout)
 {
+	if (m_deferred)
+	{
+		Record([pLayout](Context3D &pContext) { pContext.SetFragmentLayout(pLayout); });
+		return;
+	}
+
 	m_layout = pLayout;
 	m_clipper->SetFragmentLayout(pLayout);
 	m_rasterizer->SetFragmentLayout(pLayout);
 }
 
+void Context3D::SetVaryingLayout(const VaryingLayout &pLayout)
+{
+	if (!IsValidVaryingLayout(pLayout))
+	{
+		throw std::exception("Error: Varying layout does not fit in a fragment");
+	}
+
+	if (m_deferred)
+	{
+		Record([pLayout](Context3D &pContext) { pContext.SetVaryingLayout(pLayout); });
+		return;
+	}
+
+	m_clipper->SetVaryingLayout(pLayout);
+	m_rasterizer->SetVaryingLayout(pLayout);
+}
+
+void Context3D::SetCullMode(const CULL_MODE &pMode)
+{
+	if (m_deferred)
+	{
+		Record([pMode](Context3D &pContext) { pContext.SetCullMode(pMode); });
+		return;
+	}
+
+	m_clipper->SetCullMode(pMode);
+	m_rasterizer->SetCullMode(pMode);
+}
+
+void Context3D::SetGuardBand(const bool &pEnable)
+{
+	if (m_deferred)
+	{
+		Record([pEnable](Context3D &pContext) { pContext.SetGuardBand(pEnable); });
+		return;
+	}
+
+	m_clipper->SetGuardBand(pEnable);
+}
+
 void Context3D::SetVertexBuffer(std::shared_ptr<Buffer> pVertexBuffer)
 {
+	if (m_deferred)
+	{
+		Record([pVertexBuffer](Context3D &pContext) { pContext.SetVertexBuffer(pVertexBuffer); });
+		return;
+	}
+
 	m_vertex_buffer = pVertexBuffer;
 }
 
-void Context3D::SetIndexBuffer(std::shared_ptr<Buffer> pIndexBuffer)
+void Context3D::SetInstanceBuffer(std::shared_ptr<Buffer> pInstanceBuffer)
+{
+	if (m_deferred)
+	{
+		Record([pInstanceBuffer](Context3D &pContext) { pContext.SetInstanceBuffer(pInstanceBuffer); });
+		return;
+	}
+
+	m_instance_buffer = pInstanceBuffer;
+}
+
+void Context3D::SetIndexBuffer(std::shared_ptr<Buffer> pIndexBuffer, const INDEX_FORMAT &pFormat)
 {
+	if (pIndexBuffer != nullptr && pIndexBuffer->GetStride() != GetIndexFormatSize(pFormat))
+	{
+		throw std::exception("Error: Index buffer stride does not match index format");
+	}
+
+	if (m_deferred)
+	{
+		Record([pIndexBuffer, pFormat](Context3D &pContext) { pContext.SetIndexBuffer(pIndexBuffer, pFormat); });
+		return;
+	}
+
 	m_index_buffer = pIndexBuffer;
+	m_index_format = pFormat;
 }
 
 void Context3D::SetRenderTargets(std::shared_ptr<Image> pTargets[], const size_t &pNum)
 {
+	if (m_deferred)
+	{
+		std::vector<std::shared_ptr<Image>> targets(pTargets, pTargets + pNum);
+		Record([targets](Context3D &pContext) mutable { pContext.SetRenderTargets(targets.data(), targets.size()); });
+		return;
+	}
+
+	//formats are resolved here once, so writing a fragment output is a plain store
 	m_rtv_num = pNum;
 	for (size_t i = 0; i < pNum; i++)
 	{
 		m_render_targets[i] = pTargets[i];
 		m_render_targets[i]->BindRenderTarget();
+		m_target_views[i] = m_render_targets[i]->GetRenderTargetView();
+		m_target_store[i] = GetRenderTargetStoreFun(m_target_views[i].m_format);
 	}
 }
 
 void Context3D::SetShaderResources(std::shared_ptr<Image> pResources[], const size_t &pNum)
 {
+	if (m_deferred)
+	{
+		std::vector<std::shared_ptr<Image>> resources(pResources, pResources + pNum);
+		Record([resources](Context3D &pContext) mutable { pContext.SetShaderResources(resources.data(), resources.size()); });
+		return;
+	}
+
 	m_srv_num = pNum;
 	for (size_t i = 0; i < pNum; i++)
 	{
@@ -186,28 +307,98 @@ void Context3D::SeteDepthBuffer(std::shared_ptr<Image> pDepth)
 		throw std::exception("Error: Depth buffer type error");
 	}
 
+	if (m_deferred)
+	{
+		Record([pDepth](Context3D &pContext) { pContext.SeteDepthBuffer(pDepth); });
+		return;
+	}
+
 	m_depth_buffer = std::dynamic_pointer_cast<ExtensionImage<float>>(pDepth);
 	m_depth_buffer->Clear<float>(255.0f);
+	m_hiz_buffer->Resize(m_depth_buffer->GetWidth(), m_depth_buffer->GetHeight());
+	m_hiz_buffer->Clear(255.0f);
 	m_depth_buffer->BindRenderTarget();
 }
 
 void Context3D::SetVertexShader(VertexShader pVertexShader)
 {
+	if (m_deferred)
+	{
+		Record([pVertexShader](Context3D &pContext) { pContext.SetVertexShader(pVertexShader); });
+		return;
+	}
+
 	m_vertex_shader = pVertexShader;
 }
 
+void Context3D::SetInstanceVertexShader(InstanceVertexShader pVertexShader)
+{
+	if (m_deferred)
+	{
+		Record([pVertexShader](Context3D &pContext) { pContext.SetInstanceVertexShader(pVertexShader); });
+		return;
+	}
+
+	m_instance_vertex_shader = pVertexShader;
+}
+
+void Context3D::SetBatchVertexShader(BatchVertexShader pVertexShader)
+{
+	if (m_deferred)
+	{
+		Record([pVertexShader](Context3D &pContext) { pContext.SetBatchVertexShader(pVertexShader); });
+		return;
+	}
+
+	m_batch_vertex_shader = pVertexShader;
+}
+
 void Context3D::SetFragmentShader(FragmentShader pFragmentShader)
 {
+	if (m_deferred)
+	{
+		Record([pFragmentShader](Context3D &pContext) { pContext.SetFragmentShader(pFragmentShader); });
+		return;
+	}
+
 	m_fragment_shader = pFragmentShader;
 }
 
-std::shared_ptr<Image> Context3D::GetShaderResource(const size_t &pIndex)
+void Context3D::SetPacketFragmentShader(PacketFragmentShader pFragmentShader)
+{
+	if (m_deferred)
+	{
+		Record([pFragmentShader](Context3D &pContext) { pContext.SetPacketFragmentShader(pFragmentShader); });
+		return;
+	}
+
+	m_packet_fragment_shader = pFragmentShader;
+}
+
+void Context3D::SetPipelineState(std::shared_ptr<PipelineState> pPipelineState)
+{
+	if (m_deferred)
+	{
+		Record([pPipelineState](Context3D &pContext) { pContext.SetPipelineState(pPipelineState); });
+		return;
+	}
+
+	m_pipeline_state = pPipelineState;
+}
+
+const std::shared_ptr<Image> &Context3D::GetShaderResource(const size_t &pIndex) const
 {
 	return m_shader_resources[pIndex];
 }
 
 void Context3D::UnbindShaderResources()
 {
+	if (m_deferred)
+	{
+		Record([](Context3D &pContext) { pContext.UnbindShaderResources(); });
+		return;
+	}
+
 	for (size_t i = 0; i < m_srv_num; i++)
 	{
 		m_shader_resources[i]->Unbind();
@@ -218,96 +409,499 @@ void Context3D::UnbindShaderResources()
 
 void Context3D::UnbindRenderTargets()
 {
+	if (m_deferred)
+	{
+		Record([](Context3D &pContext) { pContext.UnbindRenderTargets(); });
+		return;
+	}
+
 	for (size_t i = 0; i < m_rtv_num; i++)
 	{
 		m_render_targets[i]->Unbind();
 		m_render_targets[i] = nullptr;
+		m_target_store[i] = nullptr;
 	}
 	m_rtv_num = 0;
 }
 
 void Context3D::UnbindDepthBuffer()
 {
+	if (m_deferred)
+	{
+		Record([](Context3D &pContext) { pContext.UnbindDepthBuffer(); });
+		return;
+	}
+
 	m_depth_buffer->Unbind();
 	m_depth_buffer = nullptr;
 }
 
 void Context3D::ClearDepthBuffer()
 {
+	if (m_deferred)
+	{
+		Record([](Context3D &pContext) { pContext.ClearDepthBuffer(); });
+		return;
+	}
+
 	if (m_depth_buffer != nullptr)
 	{
 		m_depth_buffer->Clear<float>(255.0f);
+		m_hiz_buffer->Clear(255.0f);
 	}
 }
 
 void Context3D::Draw()
+{
+	if (m_deferred)
+	{
+		Record([](Context3D &pContext) { pContext.Draw(); });
+		return;
+	}
+
+	DrawPrimitives(1, false);
+}
+
+void Context3D::DrawInstanced(const size_t &pInstanceCount)
+{
+	//the instance buffer is only known once the list is executed
+	if (m_deferred)
+	{
+		Record([pInstanceCount](Context3D &pContext) { pContext.DrawInstanced(pInstanceCount); });
+		return;
+	}
+
+	//a pipeline state has no instance stage, so it is rejected before any work is done
+	if (m_pipeline_state != nullptr)
+	{
+		throw std::exception("Error: pipeline state does not support instanced draws");
+	}
+
+	if (m_instance_vertex_shader == nullptr)
+	{
+		throw std::exception("Error: instance vertex shader is nullptr");
+	}
+
+	if (m_instance_buffer == nullptr)
+	{
+		throw std::exception("Error: instance buffer is nullptr");
+	}
+
+	if (m_instance_buffer->GetElementNum() < pInstanceCount)
+	{
+		throw std::exception("Error: instance buffer is smaller than instance count");
+	}
+
+	if (pInstanceCount == 0)
+	{
+		return;
+	}
+
+	DrawPrimitives(pInstanceCount, true);
+}
+
+void Context3D::ResetScratchMemory()
+{
+	if (m_deferred)
+	{
+		throw std::exception("Error: ResetScratchMemory is only valid on the immediate context");
+	}
+
+	m_frame_arena.Reset();
+
+#ifdef PARALL
+	m_thread_arenas.combine_each([](std::shared_ptr<LinearArena> &pArena) {
+		pArena->Reset();
+	});
+#endif // PARALL
+}
+
+std::shared_ptr<CommandList> Context3D::FinishCommandList()
+{
+	if (!m_deferred)
+	{
+		throw std::exception("Error: FinishCommandList is only valid on a deferred context");
+	}
+
+	std::shared_ptr<CommandList> command_list = std::make_shared<CommandList>(std::move(m_commands));
+	m_commands.clear();
+	return command_list;
+}
+
+void Context3D::ExecuteCommandList(std::shared_ptr<CommandList> pCommandList)
+{
+	if (m_deferred)
+	{
+		throw std::exception("Error: ExecuteCommandList is only valid on the immediate context");
+	}
+
+	if (pCommandList == nullptr)
+	{
+		throw std::exception("Error: command list is nullptr");
+	}
+
+	pCommandList->Execute(*this);
+}
+
+void Context3D::Record(CommandList::Command &&pCommand)
+{
+	m_commands.emplace_back(std::move(pCommand));
+}
+
+LinearArena &Context3D::GetThreadArena()
+{
+#ifdef PARALL
+	return *m_thread_arenas.local();
+#else
+	return m_frame_arena;
+#endif // PARALL
+}
+
+void Context3D::DrawPrimitives(const size_t &pInstanceCount, const bool &pInstanced)
 {
 	if ((m_vertex_buffer == nullptr) || (m_index_buffer == nullptr))
 	{
 		throw std::exception("Error: vertex buffer or index buffer is nullptr");
 	}
 
+	//a pipeline state replaces the shaders, the fragment layout and the output formats of the draw
+	const PipelineState *pipeline = m_pipeline_state.get();
+	bool packet_shading = pipeline != nullptr ? pipeline->IsPacketShading() : m_packet_fragment_shader != nullptr;
+
+	if (pipeline != nullptr)
+	{
+		if (pipeline->GetRenderTargetNum() != m_rtv_num)
+		{
+			throw std::exception("Error: render target number does not match pipeline state");
+		}
+
+		for (size_t i = 0; i < m_rtv_num; i++)
+		{
+			if (pipeline->GetRenderTargetFormat(i) != m_render_targets[i]->GetFormat())
+			{
+				throw std::exception("Error: render target format does not match pipeline state");
+			}
+		}
+	}
+
 	size_t vertex_num = m_vertex_buffer->GetElementNum();
 	Vertex *vertex_data = static_cast<Vertex*>(m_vertex_buffer->GetData());
-	Fragment *processed_vertexs = new Fragment[vertex_num];
+
+	size_t index_num = m_index_buffer->GetElementNum();
+	size_t triangle_num = index_num / 3;
+
+	//scratch memory of this draw goes back to the frame arena when the draw returns
+	ArenaScope draw_scope(m_frame_arena);
+	ArenaAllocator<unsigned char> allocator(&m_frame_arena);
+
+	ArenaVector<unsigned char> referenced(vertex_num * pInstanceCount, 0, allocator);
+	ArenaVector<IndexedTriangle> triangles(triangle_num * pInstanceCount, allocator);
+
+	switch (m_index_format)
+	{
+	case INDEX_FORMAT::R16_UINT:
+		AssembleTriangles(static_cast<const uint16_t*>(m_index_buffer->GetData()), index_num, referenced, triangles);
+		break;
+	case INDEX_FORMAT::R32_UINT:
+		AssembleTriangles(static_cast<const uint32_t*>(m_index_buffer->GetData()), index_num, referenced, triangles);
+		break;
+	default:
+		break;
+	}
+
+	//every instance owns a copy of the vertex range, so later stages never need to know about instancing
+	for (size_t i = 1; i < pInstanceCount; i++)
+	{
+		size_t vertex_offset = i * vertex_num;
+		std::memcpy(referenced.data() + vertex_offset, referenced.data(), vertex_num);
+
+		IndexedTriangle *instance_triangles = triangles.data() + i * triangle_num;
+		for (size_t j = 0; j < triangle_num; j++)
+		{
+			instance_triangles[j].m_vertex[0] = triangles[j].m_vertex[0] + vertex_offset;
+			instance_triangles[j].m_vertex[1] = triangles[j].m_vertex[1] + vertex_offset;
+			instance_triangles[j].m_vertex[2] = triangles[j].m_vertex[2] + vertex_offset;
+		}
+	}
+	triangle_num *= pInstanceCount;
+
+	ArenaVector<Fragment> processed_vertexs(vertex_num * pInstanceCount, allocator);
+	ArenaVector<uint8_t> clip_codes(vertex_num * pInstanceCount, allocator);
+
+	auto shade_vertex = [&](const size_t &i) {
+		if (!referenced[i])
+		{
+			return;
+		}
+
+		if (pInstanced)
+		{
+			size_t instance_id = i / vertex_num;
+			m_instance_vertex_shader(vertex_data[i - instance_id * vertex_num], m_instance_buffer->GetElementData(instance_id), instance_id, processed_vertexs[i]);
+		}
+		else
+		{
+			m_vertex_shader(vertex_data[i], processed_vertexs[i]);
+		}
+
+		clip_codes[i] = ComputeVertexClipCode(processed_vertexs[i].m_pos);
+	};
+
+	//vertices of all instances are shaded in a single dispatch
+	if (pipeline != nullptr)
+	{
+		pipeline->ShadeVertices(vertex_data, referenced, processed_vertexs, clip_codes);
+	}
+	else if (!pInstanced && m_batch_vertex_shader != nullptr)
+	{
+		ShadeVertexBatches(m_batch_vertex_shader, vertex_data, referenced, processed_vertexs, clip_codes);
+	}
+	else
+	{
+#ifdef PARALL
+		concurrency::parallel_for(size_t(0), processed_vertexs.size(), shade_vertex);
+#else
+		for (size_t i = 0; i < processed_vertexs.size(); i++)
+		{
+			shade_vertex(i);
+		}
+#endif // PARALL
+	}
+
+	//back faces never reach clip code computation, clipping or raster setup
+	m_clipper->Cull(triangles, processed_vertexs);
+
+	if (pipeline != nullptr)
+	{
+		pipeline->Clip(*m_clipper, triangles, processed_vertexs, clip_codes);
+	}
+	else
+	{
+		m_clipper->Clip(triangles, processed_vertexs, clip_codes);
+	}
+	triangle_num = triangles.size();
+
+	//vertices created by the clipper lie past the shaded ones and are always referenced
+	size_t shaded_num = referenced.size();
+
+	ArenaVector<float> inv_camera_z(processed_vertexs.size(), allocator);
 
 #ifdef PARALL
-	concurrency::parallel_for(size_t(0), vertex_num, [&](const size_t &i) {
-		m_vertex_shader(vertex_data[i], processed_vertexs[i]);
+	concurrency::parallel_for(size_t(0), processed_vertexs.size(), [&](const size_t &i) {
+		if (i >= shaded_num || referenced[i])
+		{
+			m_rasterizer->ProjectVertex(processed_vertexs[i], inv_camera_z[i]);
+		}
 	});
 #else
-	for (size_t i = 0; i < vertex_num; i++)
+	for (size_t i = 0; i < processed_vertexs.size(); i++)
 	{
-		m_vertex_shader(vertex_data[i], processed_vertexs[i]);
+		if (i >= shaded_num || referenced[i])
+		{
+			m_rasterizer->ProjectVertex(processed_vertexs[i], inv_camera_z[i]);
+		}
 	}
 #endif // PARALL
 
-	size_t triangle_num = m_index_buffer->GetElementNum() / 3;
-	size_t *index_data = static_cast<size_t*>(m_index_buffer->GetData());
-	Triangle *triangles = new Triangle[triangle_num];
+	ArenaVector<RasterTriangle> raster_triangles(triangle_num, allocator);
+	ArenaVector<unsigned char> visible(triangle_num, allocator);
+
+#ifdef PARALL
+	concurrency::parallel_for(size_t(0), triangle_num, [&](const size_t &i) {
+		visible[i] = m_rasterizer->SetupTriangle(triangles[i], processed_vertexs, inv_camera_z, raster_triangles[i]);
+	});
+#else
 	for (size_t i = 0; i < triangle_num; i++)
 	{
-		size_t index_begin = i * 3;
-		triangles[i].m_vertex[0] = processed_vertexs[index_data[index_begin]];
-		triangles[i].m_vertex[1] = processed_vertexs[index_data[index_begin + 1]];
-		triangles[i].m_vertex[2] = processed_vertexs[index_data[index_begin + 2]];
+		visible[i] = m_rasterizer->SetupTriangle(triangles[i], processed_vertexs, inv_camera_z, raster_triangles[i]);
 	}
+#endif // PARALL
 
-	delete[] processed_vertexs;
+	m_binner->Clear();
+	for (size_t i = 0; i < triangle_num; i++)
+	{
+		if (visible[i])
+		{
+			m_binner->Bin(i, raster_triangles[i].m_box_min, raster_triangles[i].m_box_max);
+		}
+	}
 
-	m_clipper->Clip(&triangles, triangle_num);
+	//tiles never share pixels, so every tile is rasterized and shaded by its own worker in primitive order
+	auto render_tile = [&](const size_t &pTile) {
+		const std::vector<size_t> &bin = m_binner->GetBin(pTile);
+		if (bin.empty())
+		{
+			return;
+		}
 
-	std::vector<Fragment> fragments;
-	std::vector<Vec2I> fragmentIndexes;
+		Vec2I tile_min, tile_max;
+		m_binner->GetTileRect(pTile, tile_min, tile_max);
 
+		//the arena belongs to the thread, not the tile. while the nested parallel_for of ShadeFragments waits, ppl can run
+		//another tile on this thread, that tile finishes before this one resumes, so the ArenaScopes rewind last in first out
+		//and the nested tile never frees memory this one still uses. per tile arenas would not keep that order
+		LinearArena &arena = GetThreadArena();
+		ArenaScope tile_scope(arena);
+		ArenaAllocator<Fragment> tile_allocator(&arena);
+
+		ArenaVector<Fragment> fragments(tile_allocator);
+		ArenaVector<Vec2I> fragmentIndexes(tile_allocator);
+		ArenaVector<Vec4f> fragment_out(tile_allocator);
+
+		ArenaVector<FragmentPacket> packets(tile_allocator);
+		ArenaVector<FragmentPacketOut> packet_out(tile_allocator);
+
+		if (packet_shading)
+		{
+			packets.reserve(packetBatchCapacity);
+			packet_out.reserve(packetBatchCapacity * m_rtv_num);
+		}
+		else
+		{
+			fragments.reserve(fragmentBatchCapacity);
+			fragmentIndexes.reserve(fragmentBatchCapacity);
+			fragment_out.reserve(fragmentBatchCapacity * m_rtv_num);
+		}
+
+		auto shade_fragments = [&]() {
+			if (pipeline != nullptr && packet_shading)
+			{
+				pipeline->ShadePackets(packets, packet_out, m_target_views);
+				packets.clear();
+			}
+			else if (pipeline != nullptr)
+			{
+				pipeline->ShadeFragments(fragments, fragmentIndexes, fragment_out, m_target_views);
+				fragments.clear();
+				fragmentIndexes.clear();
+			}
+			else if (packet_shading)
+			{
+				ShadePackets(packets, packet_out);
+			}
+			else
+			{
+				ShadeFragments(fragments, fragmentIndexes, fragment_out);
+			}
+		};
+
+		//fragments of consecutive triangles are collected and shaded together once the batch is full
+		for (size_t i = 0; i < bin.size(); i++)
+		{
+			if (pipeline != nullptr && packet_shading)
+			{
+				pipeline->RasterizePackets(*m_rasterizer, raster_triangles[bin[i]], tile_min, tile_max, packets, m_depth_buffer, *m_hiz_buffer);
+			}
+			else if (pipeline != nullptr)
+			{
+				pipeline->Rasterize(*m_rasterizer, raster_triangles[bin[i]], tile_min, tile_max, fragments, fragmentIndexes, m_depth_buffer, *m_hiz_buffer);
+			}
+			else if (packet_shading)
+			{
+				m_rasterizer->RasterizePackets(raster_triangles[bin[i]], tile_min, tile_max, packets, m_depth_buffer, *m_hiz_buffer);
+			}
+			else
+			{
+				m_rasterizer->Rasterize(raster_triangles[bin[i]], tile_min, tile_max, fragments, fragmentIndexes, m_depth_buffer, *m_hiz_buffer);
+			}
+
+			if (fragments.size() >= fragmentBatchSize || packets.size() >= packetBatchSize)
+			{
+				shade_fragments();
+			}
+		}
+
+		shade_fragments();
+	};
+
+#ifdef PARALL
+	concurrency::parallel_for(size_t(0), m_binner->GetTileNum(), render_tile);
+#else
+	for (size_t i = 0; i < m_binner->GetTileNum(); i++)
+	{
+		render_tile(i);
+	}
+#endif // PARALL
+}
+
+template<typename T>
+void Context3D::AssembleTriangles(const T *pIndexData, const size_t &pIndexNum, ArenaVector<unsigned char> &pReferenced, ArenaVector<IndexedTriangle> &pTriangles)
+{
+	//only vertices the index buffer refers to are shaded
+	for (size_t i = 0; i < pIndexNum; i++)
+	{
+		pReferenced[pIndexData[i]] = 1;
+	}
+
+	size_t triangle_num = pIndexNum / 3;
 	for (size_t i = 0; i < triangle_num; i++)
 	{
-		m_rasterizer->Rasterize(triangles[i], fragments, fragmentIndexes, m_depth_buffer);
+		size_t index_begin = i * 3;
+		pTriangles[i].m_vertex[0] = pIndexData[index_begin];
+		pTriangles[i].m_vertex[1] = pIndexData[index_begin + 1];
+		pTriangles[i].m_vertex[2] = pIndexData[index_begin + 2];
+	}
+}
+
+void Context3D::ShadeFragments(ArenaVector<Fragment> &pFragments, ArenaVector<Vec2I> &pFragmentIndexes, ArenaVector<Vec4f> &pFragmentOut)
+{
+	size_t fragment_size = pFragments.size();
+	if (fragment_size == 0)
+	{
+		return;
+	}
 
-		size_t fragment_size = fragments.size();
-		Vec4f *fragment_out = new Vec4f[fragment_size * m_rtv_num];
-		Vec4f *curr_fragment_out = fragment_out;
+	pFragmentOut.resize(fragment_size * m_rtv_num);
 
 #ifdef PARALL
-		concurrency::parallel_for(size_t(0), fragment_size, [&](const size_t &j) {
-			Vec4f *curr_fragment_out = fragment_out + j * m_rtv_num;
-			m_fragment_shader(fragments[j], &curr_fragment_out);
-			WriteOutputToRenderTarget(curr_fragment_out, fragmentIndexes[j]);
-		});
+	concurrency::parallel_for(size_t(0), fragment_size, [&](const size_t &i) {
+		Vec4f *curr_fragment_out = pFragmentOut.data() + i * m_rtv_num;
+		m_fragment_shader(pFragments[i], &curr_fragment_out);
+	});
 #else
-		for (size_t j = 0; j < fragment_size; j++)
-		{
-			m_fragment_shader(fragments[j], &curr_fragment_out);
-			WriteOutputToRenderTarget(curr_fragment_out, fragmentIndexes[j]);
-			curr_fragment_out += m_rtv_num;
-		}
-#endif // PARALL 
+	for (size_t i = 0; i < fragment_size; i++)
+	{
+		Vec4f *curr_fragment_out = pFragmentOut.data() + i * m_rtv_num;
+		m_fragment_shader(pFragments[i], &curr_fragment_out);
+	}
+#endif // PARALL
+
+	//a pixel can appear more than once in a batch, so outputs are written back in rasterization order
+	for (size_t i = 0; i < fragment_size; i++)
+	{
+		WriteOutputToRenderTarget(pFragmentOut.data() + i * m_rtv_num, pFragmentIndexes[i]);
+	}
+
+	pFragments.clear();
+	pFragmentIndexes.clear();
+}
+
+void Context3D::ShadePackets(ArenaVector<FragmentPacket> &pPackets, ArenaVector<FragmentPacketOut> &pPacketOut)
+{
+	size_t packet_size = pPackets.size();
+	if (packet_size == 0)
+	{
+		return;
+	}
 
-		fragments.clear();
-		fragmentIndexes.clear();
+	pPacketOut.resize(packet_size * m_rtv_num);
 
-		delete[] fragment_out;
+#ifdef PARALL
+	concurrency::parallel_for(size_t(0), packet_size, [&](const size_t &i) {
+		m_packet_fragment_shader(pPackets[i], pPacketOut.data() + i * m_rtv_num);
+	});
+#else
+	for (size_t i = 0; i < packet_size; i++)
+	{
+		m_packet_fragment_shader(pPackets[i], pPacketOut.data() + i * m_rtv_num);
+	}
+#endif // PARALL
+
+	//packets of a batch can overlap like single fragments, so they are written back in rasterization order too
+	for (size_t i = 0; i < packet_size; i++)
+	{
+		WritePacketToRenderTarget(pPacketOut.data() + i * m_rtv_num, pPackets[i]);
 	}
 
-	delete[] triangles;
+	pPackets.clear();
 }
\ No newline at end of file
@@ -6,9 +6,24 @@
 #include "Image.h"
 #include "Clipper.h"
 #include "Rasterizer.h"
+#include "Binner.h"
+#include "Pipeline.h"
 
 using VertexShader = std::function<void(const Vertex &pVertexIn, Fragment &pVertexOut)>;
+using InstanceVertexShader = std::function<void(const Vertex &pVertexIn, const void *pInstanceIn, const size_t &pInstanceID, Fragment &pVertexOut)>;
+//shades vertexBatchSize vertices at once, pVertexOut starts zeroed and lanes of unreferenced vertices are not written back
+using BatchVertexShader = std::function<void(const VertexBatch &pVertexIn, VertexBatchOut &pVertexOut)>;
 using FragmentShader = std::function<void(const Fragment &pFragmentIn, Vec4f **pFragmentOut)>;
+//shades every lane of a packet at once, pPacketOut has one entry per render target and lanes outside m_mask are not written back
+using PacketFragmentShader = std::function<void(const FragmentPacket &pPacketIn, FragmentPacketOut *pPacketOut)>;
+
+//number of fragments a tile collects before they are shaded in one dispatch
+static constexpr size_t fragmentBatchSize = tileSize * tileSize;
+//the triangle that fills a batch can add up to a whole tile on top of it, so a batch never holds more than this
+static constexpr size_t fragmentBatchCapacity = fragmentBatchSize + tileSize * tileSize;
+static constexpr size_t packetBatchSize = fragmentBatchSize / rowWidth;
+//a triangle adds at most one packet per row group of the tile
+static constexpr size_t packetBatchCapacity = packetBatchSize + tileSize * tileSize / rowWidth;
 
 class SwapChain
 {
@@ -32,6 +47,34 @@ private:
 	std::shared_ptr<Image> m_back_buffer;
 };
 
+class Context3D;
+
+//commands recorded by a deferred context, a command list can be executed any number of times
+class CommandList
+{
+public:
+	using Command = std::function<void(Context3D &pContext)>;
+
+	CommandList(std::vector<Command> &&pCommands) : m_commands(std::move(pCommands)) {};
+	~CommandList() {};
+
+	size_t GetCommandNum() const
+	{
+		return m_commands.size();
+	}
+
+	void Execute(Context3D &pContext) const
+	{
+		for (size_t i = 0; i < m_commands.size(); i++)
+		{
+			m_commands[i](pContext);
+		}
+	}
+
+private:
+	std::vector<Command> m_commands;
+};
+
 class Device3D
 {
 public:
@@ -40,30 +83,50 @@ public:
 
 	std::shared_ptr<Image> CreateImage(const ImageDesc &pDesc, const std::string &pName = " ");
 	std::shared_ptr<Buffer> CreateBuffer(const BufferDesc &pDesc);
+
+	//a deferred context records into a command list and may be used from any thread
+	std::shared_ptr<Context3D> CreateDeferredContext();
 };
 
 class Context3D
 {
 public:
-	Context3D();
+	Context3D(const bool &pDeferred = false);
 	~Context3D();
 
+	bool IsDeferred() const;
+
 	void SetViewport(const Viewport &pViewport);
 	Viewport GetViewport();
 
 	void SetFragmentLayout(const FragmentLayout &pLayout);
+	//only the declared varyings are clipped and interpolated, replaces the fragment layout
+	void SetVaryingLayout(const VaryingLayout &pLayout);
+	void SetCullMode(const CULL_MODE &pMode);
+	//on by default, triangles crossing only the side planes are not split
+	void SetGuardBand(const bool &pEnable);
 
 	void SetVertexBuffer(std::shared_ptr<Buffer> pVertexBuffer);
-	void SetIndexBuffer(std::shared_ptr<Buffer> pIndexBuffer);
+	void SetIndexBuffer(std::shared_ptr<Buffer> pIndexBuffer, const INDEX_FORMAT &pFormat = INDEX_FORMAT::R32_UINT);
+	void SetInstanceBuffer(std::shared_ptr<Buffer> pInstanceBuffer);
 
 	void SetRenderTargets(std::shared_ptr<Image> pTargets[], const size_t &pNum);
 	void SetShaderResources(std::shared_ptr<Image> pResources[], const size_t &pNum);
 	void SeteDepthBuffer(std::shared_ptr<Image> pDepth);
 
 	void SetVertexShader(VertexShader pVertexShader);
+	void SetInstanceVertexShader(InstanceVertexShader pVertexShader);
+	//when set, draws without a pipeline state or instancing shade their vertices with it instead of the vertex shader
+	void SetBatchVertexShader(BatchVertexShader pVertexShader);
 	void SetFragmentShader(FragmentShader pFragmentShader);
+	//when set, draws without a pipeline state rasterize into packets and shade them with it instead of the fragment shader
+	void SetPacketFragmentShader(PacketFragmentShader pFragmentShader);
 
-	std::shared_ptr<Image> GetShaderResource(const size_t &pIndex);
+	//when set, draws use the shaders, layout and formats of the pipeline state instead of the ones above
+	void SetPipelineState(std::shared_ptr<PipelineState> pPipelineState);
+
+	//returned by reference, shaders that read it per fragment do not touch the reference count
+	const std::shared_ptr<Image> &GetShaderResource(const size_t &pIndex) const;
 
 	void UnbindShaderResources();
 	void UnbindRenderTargets();
@@ -72,58 +135,92 @@ public:
 	void ClearDepthBuffer();
 
 	void Draw();
+	void DrawInstanced(const size_t &pInstanceCount);
+
+	//draws and tiles rewind their arenas when they return, this is called once per frame after Present
+	//to merge the blocks a frame overflowed into one, so the next frame fits without allocating
+	void ResetScratchMemory();
+
+	//deferred context only, hands over the recorded commands and starts a new list
+	std::shared_ptr<CommandList> FinishCommandList();
+	//immediate context only, replays the commands in the order they were recorded
+	void ExecuteCommandList(std::shared_ptr<CommandList> pCommandList);
 
 private:
+	void Record(CommandList::Command &&pCommand);
+
+	void DrawPrimitives(const size_t &pInstanceCount, const bool &pInstanced);
+
+	template<typename T>
+	void AssembleTriangles(const T *pIndexData, const size_t &pIndexNum, ArenaVector<unsigned char> &pReferenced, ArenaVector<IndexedTriangle> &pTriangles);
+
+	LinearArena &GetThreadArena();
+
+	void ShadeFragments(ArenaVector<Fragment> &pFragments, ArenaVector<Vec2I> &pFragmentIndexes, ArenaVector<Vec4f> &pFragmentOut);
+
 	void WriteOutputToRenderTarget(Vec4f *pOut, const Vec2I &pIndex)
 	{
 		for (size_t i = 0; i < m_rtv_num; i++)
 		{
-			IMAGE_FORMAT format = m_render_targets[i]->GetFormat();
-			Vec4f out = pOut[i];
+			m_target_store[i](m_target_views[i], pIndex, pOut[i]);
+		}
+	}
+
+	void ShadePackets(ArenaVector<FragmentPacket> &pPackets, ArenaVector<FragmentPacketOut> &pPacketOut);
+
+	void WritePacketToRenderTarget(const FragmentPacketOut *pOut, const FragmentPacket &pPacket)
+	{
+		for (int k = 0; k < rowWidth; k++)
+		{
+			if ((pPacket.m_mask & (1 << k)) == 0)
+			{
+				continue;
+			}
 
-			switch (format)
+			Vec2I index(pPacket.m_origin.x + k, pPacket.m_origin.y);
+			for (size_t i = 0; i < m_rtv_num; i++)
 			{
-			case R32_FLOAT:
-				std::dynamic_pointer_cast<ExtensionImage<float>>(m_render_targets[i])->SetPixel(out.x, pIndex);
-				break;
-			case R32G32_FLOAT:
-				std::dynamic_pointer_cast<ExtensionImage<Vec2f>>(m_render_targets[i])->SetPixel(Vec2f(out.x, out.y), pIndex);
-				break;
-			case R32G32B32_FLOAT:
-				std::dynamic_pointer_cast<ExtensionImage<Vec3f>>(m_render_targets[i])->SetPixel(Vec3f(out.x, out.y, out.z), pIndex);
-				break;
-			case R32G32B32A32_FLOAT:
-				std::dynamic_pointer_cast<ExtensionImage<Vec4f>>(m_render_targets[i])->SetPixel(out, pIndex);
-				break;
-			case R8G8B8A8_UINT:		
-				{
-					//std::dynamic_pointer_cast<ExtensionImage<Vec4<uint8_t>>>(m_render_targets[i])->SetPixel(Vec4<uint8_t>(out.y * 255, out.z * 255, out.x * 255, out.w * 255), pIndex.x, m_render_targets[i]->GetHeight() - 1 - pIndex.y);
-					std::dynamic_pointer_cast<ExtensionImage<Vec4<uint8_t>>>(m_render_targets[i])->SetPixel(Vec4<uint8_t>(static_cast<uint8_t>(out.b * 255), static_cast<uint8_t>(out.g * 255), static_cast<uint8_t>(out.r * 255), 1), pIndex.x, m_render_targets[i]->GetHeight() - 1 - pIndex.y);
-				}
-				break;
-			default:
-				break;
+				Vec4f color(pOut[i].m_value[0][k], pOut[i].m_value[1][k], pOut[i].m_value[2][k], pOut[i].m_value[3][k]);
+				m_target_store[i](m_target_views[i], index, color);
 			}
 		}
 	}
 
 	VertexShader m_vertex_shader;
+	InstanceVertexShader m_instance_vertex_shader;
+	BatchVertexShader m_batch_vertex_shader;
 	FragmentShader m_fragment_shader;
+	PacketFragmentShader m_packet_fragment_shader;
+	std::shared_ptr<PipelineState> m_pipeline_state;
 
 	std::shared_ptr<Image> m_shader_resources[5];
 	std::shared_ptr<Image> m_render_targets[5];
+	RenderTargetView m_target_views[5];
+	RenderTargetStoreFun m_target_store[5];
 	std::shared_ptr<ExtensionImage<float>> m_depth_buffer;
+	std::shared_ptr<HiZBuffer> m_hiz_buffer;
 
 	std::shared_ptr<Buffer> m_vertex_buffer;
 	std::shared_ptr<Buffer> m_index_buffer;
+	std::shared_ptr<Buffer> m_instance_buffer;
+	INDEX_FORMAT m_index_format;
 
 	std::shared_ptr<Clipper> m_clipper;
 	std::shared_ptr<Rasterizer> m_rasterizer;
+	std::shared_ptr<Binner> m_binner;
+
+	LinearArena m_frame_arena;
+#ifdef PARALL
+	concurrency::combinable<std::shared_ptr<LinearArena>> m_thread_arenas;
+#endif // PARALL
 
 	size_t m_srv_num;
 	size_t m_rtv_num;
 
 	FragmentLayout m_layout;
 	Viewport m_viewport;
+
+	bool m_deferred;
+	std::vector<CommandList::Command> m_commands;
 };
 #endif // !RENDERINTERFACE_H
@@ -0,0 +1,221 @@
+#pragma once
+#ifndef ROWEVALUATOR_H
+#define ROWEVALUATOR_H
+#include "PCH.h"
+#include "CPUFeature.h"
+#include <cstdint>
+
+//pixels of a block row that are evaluated together
+static constexpr int rowWidth = 8;
+
+//per triangle constants of the row evaluation, the change of each edge function, of z and of 1 / w per pixel in x
+struct RowTriangle
+{
+	int64_t m_step[3];
+	float m_z_step;
+	float m_inv_camera_z_step;
+};
+
+//coverage only, bit k is set when pixel k of the row is inside all three edges
+using RowCoverageFun = int(*)(const RowTriangle &pTriangle, const int64_t *pEdge);
+
+inline int CoverRowScalar(const RowTriangle &pTriangle, const int64_t *pEdge)
+{
+	int mask = 0;
+
+	for (int k = 0; k < rowWidth; k++)
+	{
+		int64_t e0 = pEdge[0] + k * pTriangle.m_step[0];
+		int64_t e1 = pEdge[1] + k * pTriangle.m_step[1];
+		int64_t e2 = pEdge[2] + k * pTriangle.m_step[2];
+
+		if ((e0 | e1 | e2) >= 0)
+		{
+			mask |= 1 << k;
+		}
+	}
+
+	return mask;
+}
+
+//two 64 bit lanes per register, a pixel is covered when the or of its edge values has no sign bit
+inline int CoverRowSSE4(const RowTriangle &pTriangle, const int64_t *pEdge)
+{
+	__m128i edge[3], step[3];
+	for (int i = 0; i < 3; i++)
+	{
+		edge[i] = _mm_add_epi64(_mm_set1_epi64x(pEdge[i]), _mm_set_epi64x(pTriangle.m_step[i], 0));
+		step[i] = _mm_set1_epi64x(2 * pTriangle.m_step[i]);
+	}
+
+	int outside = 0;
+	for (int pair = 0; pair < rowWidth; pair += 2)
+	{
+		__m128i sign = _mm_or_si128(_mm_or_si128(edge[0], edge[1]), edge[2]);
+		outside |= _mm_movemask_pd(_mm_castsi128_pd(sign)) << pair;
+
+		for (int i = 0; i < 3; i++)
+		{
+			edge[i] = _mm_add_epi64(edge[i], step[i]);
+		}
+	}
+
+	return ~outside & ((1 << rowWidth) - 1);
+}
+
+inline int CoverRowAVX2(const RowTriangle &pTriangle, const int64_t *pEdge)
+{
+	__m256i low[3], high[3];
+	for (int i = 0; i < 3; i++)
+	{
+		const int64_t &step = pTriangle.m_step[i];
+		low[i] = _mm256_add_epi64(_mm256_set1_epi64x(pEdge[i]), _mm256_setr_epi64x(0, step, 2 * step, 3 * step));
+		high[i] = _mm256_add_epi64(low[i], _mm256_set1_epi64x(4 * step));
+	}
+
+	__m256i low_sign = _mm256_or_si256(_mm256_or_si256(low[0], low[1]), low[2]);
+	__m256i high_sign = _mm256_or_si256(_mm256_or_si256(high[0], high[1]), high[2]);
+	int outside = _mm256_movemask_pd(_mm256_castsi256_pd(low_sign)) | (_mm256_movemask_pd(_mm256_castsi256_pd(high_sign)) << 4);
+
+	return ~outside & ((1 << rowWidth) - 1);
+}
+
+//every path evaluates a row with the same float operations in the same order, so all of them give identical results.
+//pZ and pInvCameraZ are the z and 1 / w planes at the first pixel of the row, pixel k adds k steps to them.
+//covered pixels that pass the depth test get their depth written and their w stored in pCameraZ,
+//the returned bit mask marks them
+using RowEvalFun = int(*)(const RowTriangle &pTriangle, const int64_t *pEdge, const float &pZ, const float &pInvCameraZ, const bool &pTestCoverage,
+	float *pDepth, float *pCameraZ);
+
+inline int EvaluateRowScalar(const RowTriangle &pTriangle, const int64_t *pEdge, const int &pCount, const float &pZ, const float &pInvCameraZ, const bool &pTestCoverage,
+	float *pDepth, float *pCameraZ)
+{
+	int mask = 0;
+
+	for (int k = 0; k < pCount; k++)
+	{
+		int64_t e0 = pEdge[0] + k * pTriangle.m_step[0];
+		int64_t e1 = pEdge[1] + k * pTriangle.m_step[1];
+		int64_t e2 = pEdge[2] + k * pTriangle.m_step[2];
+
+		if (pTestCoverage && (e0 | e1 | e2) < 0)
+		{
+			continue;
+		}
+
+		float curr_ndc_z = pZ + static_cast<float>(k) * pTriangle.m_z_step;
+
+		if (curr_ndc_z < pDepth[k])
+		{
+			pDepth[k] = curr_ndc_z;
+			pCameraZ[k] = 1 / (pInvCameraZ + static_cast<float>(k) * pTriangle.m_inv_camera_z_step);
+
+			mask |= 1 << k;
+		}
+	}
+
+	return mask;
+}
+
+inline int EvaluateRowScalarFull(const RowTriangle &pTriangle, const int64_t *pEdge, const float &pZ, const float &pInvCameraZ, const bool &pTestCoverage,
+	float *pDepth, float *pCameraZ)
+{
+	return EvaluateRowScalar(pTriangle, pEdge, rowWidth, pZ, pInvCameraZ, pTestCoverage, pDepth, pCameraZ);
+}
+
+//two 4 wide halves
+inline int EvaluateRowSSE4(const RowTriangle &pTriangle, const int64_t *pEdge, const float &pZ, const float &pInvCameraZ, const bool &pTestCoverage,
+	float *pDepth, float *pCameraZ)
+{
+	int covered = pTestCoverage ? CoverRowSSE4(pTriangle, pEdge) : (1 << rowWidth) - 1;
+	if (covered == 0)
+	{
+		return 0;
+	}
+
+	int mask = 0;
+
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128i lane_bit = _mm_setr_epi32(1, 2, 4, 8);
+
+	for (int half = 0; half < rowWidth; half += 4)
+	{
+		__m128 k = _mm_setr_ps(static_cast<float>(half), static_cast<float>(half + 1), static_cast<float>(half + 2), static_cast<float>(half + 3));
+
+		__m128 curr_ndc_z = _mm_add_ps(_mm_set1_ps(pZ), _mm_mul_ps(k, _mm_set1_ps(pTriangle.m_z_step)));
+		__m128 curr_inv_camera_z = _mm_add_ps(_mm_set1_ps(pInvCameraZ), _mm_mul_ps(k, _mm_set1_ps(pTriangle.m_inv_camera_z_step)));
+
+		__m128 covered_lanes = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(covered >> half), lane_bit), lane_bit));
+
+		__m128 depth = _mm_loadu_ps(pDepth + half);
+		__m128 pass = _mm_and_ps(_mm_cmplt_ps(curr_ndc_z, depth), covered_lanes);
+
+		_mm_storeu_ps(pDepth + half, _mm_blendv_ps(depth, curr_ndc_z, pass));
+		_mm_storeu_ps(pCameraZ + half, _mm_div_ps(one, curr_inv_camera_z));
+
+		mask |= _mm_movemask_ps(pass) << half;
+	}
+
+	return mask;
+}
+
+inline int EvaluateRowAVX2(const RowTriangle &pTriangle, const int64_t *pEdge, const float &pZ, const float &pInvCameraZ, const bool &pTestCoverage,
+	float *pDepth, float *pCameraZ)
+{
+	int covered = pTestCoverage ? CoverRowAVX2(pTriangle, pEdge) : (1 << rowWidth) - 1;
+	if (covered == 0)
+	{
+		return 0;
+	}
+
+	const __m256 k = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+	const __m256i lane_bit = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+
+	__m256 curr_ndc_z = _mm256_add_ps(_mm256_set1_ps(pZ), _mm256_mul_ps(k, _mm256_set1_ps(pTriangle.m_z_step)));
+	__m256 curr_inv_camera_z = _mm256_add_ps(_mm256_set1_ps(pInvCameraZ), _mm256_mul_ps(k, _mm256_set1_ps(pTriangle.m_inv_camera_z_step)));
+
+	__m256 covered_lanes = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(covered), lane_bit), lane_bit));
+
+	__m256 depth = _mm256_loadu_ps(pDepth);
+	__m256 pass = _mm256_and_ps(_mm256_cmp_ps(curr_ndc_z, depth, _CMP_LT_OQ), covered_lanes);
+
+	_mm256_storeu_ps(pDepth, _mm256_blendv_ps(depth, curr_ndc_z, pass));
+	_mm256_storeu_ps(pCameraZ, _mm256_div_ps(_mm256_set1_ps(1.0f), curr_inv_camera_z));
+
+	return _mm256_movemask_ps(pass);
+}
+
+inline RowCoverageFun SelectRowCoverageFun()
+{
+	const CPUFeature &feature = GetCPUFeature();
+
+	if (feature.m_avx2)
+	{
+		return CoverRowAVX2;
+	}
+
+	if (feature.m_sse41)
+	{
+		return CoverRowSSE4;
+	}
+
+	return CoverRowScalar;
+}
+
+inline RowEvalFun SelectRowEvalFun()
+{
+	const CPUFeature &feature = GetCPUFeature();
+
+	if (feature.m_avx2)
+	{
+		return EvaluateRowAVX2;
+	}
+
+	if (feature.m_sse41)
+	{
+		return EvaluateRowSSE4;
+	}
+
+	return EvaluateRowScalarFull;
+}
+#endif // !ROWEVALUATOR_H
@@ -0,0 +1,259 @@
+#pragma once
+#ifndef VERTEXBATCH_H
+#define VERTEXBATCH_H
+#include "PCH.h"
+#include "WideVector.h"
+#include "Arena.h"
+#include "Clipper.h"
+#include "Rasterizer.h"
+#include <cstddef>
+#include <type_traits>
+
+//a batch vertex shader transforms 8 vertices at once, it is called as void(const VertexBatch&, VertexBatchOut&).
+//both sides are structure of arrays, float i of vertex k is m_value[i][k], so every attribute loads as a wide vector
+static constexpr size_t vertexBatchSize = 8;
+static constexpr size_t vertexFloatNum = sizeof(Vertex) / sizeof(float);
+
+static_assert(vertexBatchSize == 8, "batch vertex shaders work on Float8 lanes");
+static_assert(vertexFloatNum % 4 == 0, "vertices are transposed in blocks of 4 floats");
+
+//offsets of the vertex attributes in floats, the output uses the varying offsets such as NormalVarying::offset
+static constexpr size_t vertexPosOffset = offsetof(Vertex, m_pos) / sizeof(float);
+static constexpr size_t vertexNormalOffset = offsetof(Vertex, m_normal) / sizeof(float);
+static constexpr size_t vertexUVOffset = offsetof(Vertex, m_uv) / sizeof(float);
+static constexpr size_t vertexPack0Offset = offsetof(Vertex, pack0) / sizeof(float);
+static constexpr size_t vertexPack1Offset = offsetof(Vertex, pack1) / sizeof(float);
+
+struct VertexBatch
+{
+	alignas(16) float m_value[vertexFloatNum][vertexBatchSize];
+};
+
+//zeroed before the shader runs, like a Fragment
+struct VertexBatchOut
+{
+	alignas(16) float m_value[fragmentFloatNum][vertexBatchSize];
+};
+
+//register wide stores, the rows a shader leaves zero are read back with wide loads that a memset of smaller stores would stall
+inline void ClearVertexBatchOut(VertexBatchOut &pOut)
+{
+	for (size_t i = 0; i < fragmentFloatNum; i++)
+	{
+		_mm_store_ps(pOut.m_value[i], _mm_setzero_ps());
+		_mm_store_ps(pOut.m_value[i] + 4, _mm_setzero_ps());
+	}
+}
+
+template<typename VS, typename = void>
+struct IsBatchVertexShader : std::false_type {};
+
+template<typename VS>
+struct IsBatchVertexShader<VS, decltype(std::declval<const VS&>()(std::declval<const VertexBatch&>(), std::declval<VertexBatchOut&>()), void())> : std::true_type {};
+
+//pCount is at most vertexBatchSize, the lanes behind it repeat the last vertex so they stay finite
+inline void LoadVertexBatch(const Vertex *pVertices, const size_t &pCount, VertexBatch &pBatch)
+{
+	for (size_t lane = 0; lane < vertexBatchSize; lane += 4)
+	{
+		const float *src[4];
+		for (size_t k = 0; k < 4; k++)
+		{
+			src[k] = reinterpret_cast<const float*>(pVertices + min(lane + k, pCount - 1));
+		}
+
+		for (size_t i = 0; i < vertexFloatNum; i += 4)
+		{
+			__m128 row0 = _mm_loadu_ps(src[0] + i);
+			__m128 row1 = _mm_loadu_ps(src[1] + i);
+			__m128 row2 = _mm_loadu_ps(src[2] + i);
+			__m128 row3 = _mm_loadu_ps(src[3] + i);
+			_MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+
+			_mm_store_ps(pBatch.m_value[i] + lane, row0);
+			_mm_store_ps(pBatch.m_value[i + 1] + lane, row1);
+			_mm_store_ps(pBatch.m_value[i + 2] + lane, row2);
+			_mm_store_ps(pBatch.m_value[i + 3] + lane, row3);
+		}
+	}
+}
+
+inline Float8 LoadBatchScalar(const VertexBatch &pBatch, const size_t &pOffset)
+{
+	return Float8(_mm_load_ps(pBatch.m_value[pOffset]), _mm_load_ps(pBatch.m_value[pOffset] + 4));
+}
+
+inline Vec2f8 LoadBatchVector2(const VertexBatch &pBatch, const size_t &pOffset)
+{
+	return Vec2f8(LoadBatchScalar(pBatch, pOffset), LoadBatchScalar(pBatch, pOffset + 1));
+}
+
+inline Vec3f8 LoadBatchVector3(const VertexBatch &pBatch, const size_t &pOffset)
+{
+	return Vec3f8(LoadBatchScalar(pBatch, pOffset), LoadBatchScalar(pBatch, pOffset + 1), LoadBatchScalar(pBatch, pOffset + 2));
+}
+
+inline Vec4f8 LoadBatchVector4(const VertexBatch &pBatch, const size_t &pOffset)
+{
+	return Vec4f8(LoadBatchScalar(pBatch, pOffset), LoadBatchScalar(pBatch, pOffset + 1), LoadBatchScalar(pBatch, pOffset + 2),
+		LoadBatchScalar(pBatch, pOffset + 3));
+}
+
+inline void StoreBatchScalar(VertexBatchOut &pOut, const size_t &pOffset, const Float8 &pValue)
+{
+	_mm_store_ps(pOut.m_value[pOffset], pValue.m_value[0]);
+	_mm_store_ps(pOut.m_value[pOffset] + 4, pValue.m_value[1]);
+}
+
+inline void StoreBatchVector2(VertexBatchOut &pOut, const size_t &pOffset, const Vec2f8 &pValue)
+{
+	StoreBatchScalar(pOut, pOffset, pValue.x);
+	StoreBatchScalar(pOut, pOffset + 1, pValue.y);
+}
+
+inline void StoreBatchVector3(VertexBatchOut &pOut, const size_t &pOffset, const Vec3f8 &pValue)
+{
+	StoreBatchScalar(pOut, pOffset, pValue.x);
+	StoreBatchScalar(pOut, pOffset + 1, pValue.y);
+	StoreBatchScalar(pOut, pOffset + 2, pValue.z);
+}
+
+inline void StoreBatchVector4(VertexBatchOut &pOut, const size_t &pOffset, const Vec4f8 &pValue)
+{
+	StoreBatchScalar(pOut, pOffset, pValue.x);
+	StoreBatchScalar(pOut, pOffset + 1, pValue.y);
+	StoreBatchScalar(pOut, pOffset + 2, pValue.z);
+	StoreBatchScalar(pOut, pOffset + 3, pValue.w);
+}
+
+//the clip space position, m_pos of Fragment
+inline void StoreBatchPosition(VertexBatchOut &pOut, const Vec4f8 &pPos)
+{
+	StoreBatchVector4(pOut, offsetof(Fragment, m_pos) / sizeof(float), pPos);
+}
+
+inline Vec4f8 LoadBatchPosition(const VertexBatchOut &pOut)
+{
+	size_t offset = offsetof(Fragment, m_pos) / sizeof(float);
+	return Vec4f8(Float8::Load(pOut.m_value[offset]), Float8::Load(pOut.m_value[offset + 1]), Float8::Load(pOut.m_value[offset + 2]),
+		Float8::Load(pOut.m_value[offset + 3]));
+}
+
+//writes lane k to pFragments[k] for the lanes in pMask, the floats that fill a whole register are transposed back 4 lanes at a time
+inline void StoreVertexBatch(const VertexBatchOut &pOut, const int &pMask, Fragment *pFragments)
+{
+	static constexpr size_t blockFloatNum = fragmentFloatNum / 4 * 4;
+
+	for (size_t lane = 0; lane < vertexBatchSize; lane += 4)
+	{
+		int lane_mask = (pMask >> lane) & 0xf;
+		if (lane_mask == 0)
+		{
+			continue;
+		}
+
+		float *data[4] = {};
+		for (int k = 0; k < 4; k++)
+		{
+			if (lane_mask & (1 << k))
+			{
+				data[k] = FragmentData(pFragments[lane + k]);
+			}
+		}
+
+		for (size_t i = 0; i < blockFloatNum; i += 4)
+		{
+			__m128 row0 = _mm_load_ps(pOut.m_value[i] + lane);
+			__m128 row1 = _mm_load_ps(pOut.m_value[i + 1] + lane);
+			__m128 row2 = _mm_load_ps(pOut.m_value[i + 2] + lane);
+			__m128 row3 = _mm_load_ps(pOut.m_value[i + 3] + lane);
+			_MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+
+			//all 4 vertices are referenced in most batches, only partial ones test every lane
+			if (lane_mask == 0xf)
+			{
+				_mm_storeu_ps(data[0] + i, row0);
+				_mm_storeu_ps(data[1] + i, row1);
+				_mm_storeu_ps(data[2] + i, row2);
+				_mm_storeu_ps(data[3] + i, row3);
+			}
+			else
+			{
+				const __m128 row[4] = { row0, row1, row2, row3 };
+				for (int k = 0; k < 4; k++)
+				{
+					if (lane_mask & (1 << k))
+					{
+						_mm_storeu_ps(data[k] + i, row[k]);
+					}
+				}
+			}
+		}
+
+		for (int k = 0; k < 4; k++)
+		{
+			if (lane_mask & (1 << k))
+			{
+				for (size_t i = blockFloatNum; i < fragmentFloatNum; i++)
+				{
+					data[k][i] = pOut.m_value[i][lane + k];
+				}
+			}
+		}
+	}
+}
+
+//shades the referenced vertices in batches of vertexBatchSize, batches without a referenced vertex are skipped.
+//only referenced lanes are written back to pVertexOut, together with their clip codes
+template<typename BatchVS>
+void ShadeVertexBatches(const BatchVS &pShader, const Vertex *pVertices, const ArenaVector<unsigned char> &pReferenced, ArenaVector<Fragment> &pVertexOut,
+	ArenaVector<uint8_t> &pClipCodes)
+{
+	size_t vertex_num = pVertexOut.size();
+	size_t batch_num = (vertex_num + vertexBatchSize - 1) / vertexBatchSize;
+
+	auto shade_batch = [&](const size_t &b) {
+		size_t first = b * vertexBatchSize;
+		size_t count = min(vertexBatchSize, vertex_num - first);
+
+		int mask = 0;
+		for (size_t k = 0; k < count; k++)
+		{
+			mask |= pReferenced[first + k] ? 1 << k : 0;
+		}
+
+		if (mask == 0)
+		{
+			return;
+		}
+
+		VertexBatch batch;
+		VertexBatchOut batch_out;
+		ClearVertexBatchOut(batch_out);
+		LoadVertexBatch(pVertices + first, count, batch);
+		pShader(batch, batch_out);
+
+		uint8_t clip_codes[vertexBatchSize];
+		ComputeVertexClipCodes(LoadBatchPosition(batch_out), clip_codes);
+
+		for (size_t k = 0; k < count; k++)
+		{
+			if (mask & (1 << k))
+			{
+				pClipCodes[first + k] = clip_codes[k];
+			}
+		}
+
+		StoreVertexBatch(batch_out, mask, pVertexOut.data() + first);
+	};
+
+#ifdef PARALL
+	concurrency::parallel_for(size_t(0), batch_num, shade_batch);
+#else
+	for (size_t b = 0; b < batch_num; b++)
+	{
+		shade_batch(b);
+	}
+#endif // PARALL
+}
+#endif // !VERTEXBATCH_H
@@ -3,6 +3,7 @@
 #define MATRIX_H
 #include "PCH.h"
 #include "Vector.h"
+#include <emmintrin.h>
 
 /*-----------*/
 /* Matrix3x3 */
@@ -340,5 +341,82 @@ Matrix4x4<U> ZeroMatrix4x4()
 	return mat;
 }
 
+/*------------------*/
+/* Matrix4x4<float> */
+/*------------------*/
+//same interface as Matrix4x4<T>, each row is worked on as one sse register.
+//matrices are also read straight out of instance buffers, whose bytes are not 16 byte aligned on win32,
+//so like Vec4<float> the floats keep their alignment and rows are loaded and stored unaligned
+template<>
+class Matrix4x4<float>
+{
+public:
+	Matrix4x4() {}
+
+	Matrix4x4(float arr[4][4])
+	{
+		for (uint8_t i = 0; i < 4; i++)
+		{
+			SetRow(i, _mm_loadu_ps(arr[i]));
+		}
+	}
+
+	Matrix4x4(float a00, float a01, float a02, float a03,
+		float a10, float a11, float a12, float a13,
+		float a20, float a21, float a22, float a23,
+		float a30, float a31, float a32, float a33)
+	{
+		SetRow(0, _mm_setr_ps(a00, a01, a02, a03));
+		SetRow(1, _mm_setr_ps(a10, a11, a12, a13));
+		SetRow(2, _mm_setr_ps(a20, a21, a22, a23));
+		SetRow(3, _mm_setr_ps(a30, a31, a32, a33));
+	}
+
+	const float* operator [] (uint8_t i) const { return matrix[i]; }
+	float* operator [] (uint8_t i) { return matrix[i]; }
+
+	__m128 Row(uint8_t i) const { return _mm_loadu_ps(matrix[i]); }
+	void SetRow(uint8_t i, const __m128 &v) { _mm_storeu_ps(matrix[i], v); }
+
+	//the row vector v times the matrix, the elements of v are broadcast and summed in the order of the scalar code
+	__m128 TransformRow(const __m128 &v) const
+	{
+		__m128 row = _mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)), Row(0));
+		row = _mm_add_ps(row, _mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)), Row(1)));
+		row = _mm_add_ps(row, _mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2)), Row(2)));
+		row = _mm_add_ps(row, _mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3)), Row(3)));
+		return row;
+	}
+
+	Matrix4x4 &operator*=(const Matrix4x4 &rhs)
+	{
+		__m128 mat[4];
+		for (uint8_t i = 0; i < 4; i++)
+		{
+			mat[i] = rhs.TransformRow(Row(i));
+		}
+
+		for (uint8_t i = 0; i < 4; i++)
+		{
+			SetRow(i, mat[i]);
+		}
+		return *this;
+	}
+
+	float matrix[4][4] = { 0 };
+};
+
+template<>
+inline Matrix4x4<float> operator*(const Matrix4x4<float> &lhs, const Matrix4x4<float> &rhs)
+{
+	Matrix4x4<float> mat;
+	for (uint8_t i = 0; i < 4; i++)
+	{
+		mat.SetRow(i, rhs.TransformRow(lhs.Row(i)));
+	}
+
+	return mat;
+}
+
 using Matrix4x4f = Matrix4x4<float>;
 #endif // !MATRIX_H
@@ -194,6 +194,34 @@ Matrix4x4<T> Matrix4x4Inverse(const Matrix4x4<T> &m)
 	{
 		T inv_det = 1 / det;
 
+		mat[0][0] = (m[1][1] * m[2][2] * m[3][3] +
+			m[1][2] * m[2][3] * m[3][1] +
+			m[1][3] * m[2][1] * m[3][2] -
+			m[1][1] * m[2][3] * m[3][2] -
+			m[1][2] * m[2][1] * m[3][3] -
+			m[1][3] * m[2][2] * m[3][1]) * inv_det;
+
+		mat[1][0] = (m[1][0] * m[2][3] * m[3][2] +
+			m[1][2] * m[2][0] * m[3][3] +
+			m[1][3] * m[2][2] * m[3][0] -
+			m[1][0] * m[2][2] * m[3][3] -
+			m[1][2] * m[2][3] * m[3][0] -
+			m[1][3] * m[2][0] * m[3][2]) * inv_det;
+
+		mat[2][0] = (m[1][0] * m[2][1] * m[3][3] +
+			m[1][1] * m[2][3] * m[3][0] +
+			m[1][3] * m[2][0] * m[3][1] -
+			m[1][0] * m[2][3] * m[3][1] -
+			m[1][1] * m[2][0] * m[3][3] -
+			m[1][3] * m[2][1] * m[3][0]) * inv_det;
+
+		mat[3][0] = (m[1][0] * m[2][2] * m[3][1] +
+			m[1][1] * m[2][0] * m[3][2] +
+			m[1][2] * m[2][1] * m[3][0] -
+			m[1][0] * m[2][1] * m[3][2] -
+			m[1][1] * m[2][2] * m[3][0] -
+			m[1][2] * m[2][0] * m[3][1]) * inv_det;
+
 		mat[0][1] = (m[0][1] * m[2][3] * m[3][2] +
 			m[0][2] * m[2][1] * m[3][3] +
 			m[0][3] * m[2][2] * m[3][1] -
@@ -296,6 +324,97 @@ Matrix4x4<T> Matrix4x4Transpose(const Matrix4x4<T> &m)
 	return mat;
 }
 
+//the inverse by 2x2 blocks, with m = | A B | every block is two rows of two floats in one register.
+//  | C D |
+//adj(X) is the adjugate of a 2x2 block, [a b c d] -> [d -b -c a]
+inline __m128 Matrix2x2Mul(const __m128 &lhs, const __m128 &rhs)
+{
+	return _mm_add_ps(_mm_mul_ps(lhs, _mm_shuffle_ps(rhs, rhs, _MM_SHUFFLE(3, 0, 3, 0))),
+		_mm_mul_ps(_mm_shuffle_ps(lhs, lhs, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(rhs, rhs, _MM_SHUFFLE(1, 2, 1, 2))));
+}
+
+//adj(lhs) * rhs
+inline __m128 Matrix2x2AdjMul(const __m128 &lhs, const __m128 &rhs)
+{
+	return _mm_sub_ps(_mm_mul_ps(_mm_shuffle_ps(lhs, lhs, _MM_SHUFFLE(0, 0, 3, 3)), rhs),
+		_mm_mul_ps(_mm_shuffle_ps(lhs, lhs, _MM_SHUFFLE(2, 2, 1, 1)), _mm_shuffle_ps(rhs, rhs, _MM_SHUFFLE(1, 0, 3, 2))));
+}
+
+//lhs * adj(rhs)
+inline __m128 Matrix2x2MulAdj(const __m128 &lhs, const __m128 &rhs)
+{
+	return _mm_sub_ps(_mm_mul_ps(lhs, _mm_shuffle_ps(rhs, rhs, _MM_SHUFFLE(0, 3, 0, 3))),
+		_mm_mul_ps(_mm_shuffle_ps(lhs, lhs, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(rhs, rhs, _MM_SHUFFLE(1, 2, 1, 2))));
+}
+
+template<>
+inline Matrix4x4<float> Matrix4x4Inverse(const Matrix4x4<float> &m)
+{
+	__m128 row0 = m.Row(0), row1 = m.Row(1), row2 = m.Row(2), row3 = m.Row(3);
+
+	__m128 a = _mm_movelh_ps(row0, row1);
+	__m128 b = _mm_movehl_ps(row1, row0);
+	__m128 c = _mm_movelh_ps(row2, row3);
+	__m128 d = _mm_movehl_ps(row3, row2);
+
+	//(|A| |B| |C| |D|)
+	__m128 det_sub = _mm_sub_ps(
+		_mm_mul_ps(_mm_shuffle_ps(row0, row2, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(row1, row3, _MM_SHUFFLE(3, 1, 3, 1))),
+		_mm_mul_ps(_mm_shuffle_ps(row0, row2, _MM_SHUFFLE(3, 1, 3, 1)), _mm_shuffle_ps(row1, row3, _MM_SHUFFLE(2, 0, 2, 0))));
+	__m128 det_a = _mm_shuffle_ps(det_sub, det_sub, _MM_SHUFFLE(0, 0, 0, 0));
+	__m128 det_b = _mm_shuffle_ps(det_sub, det_sub, _MM_SHUFFLE(1, 1, 1, 1));
+	__m128 det_c = _mm_shuffle_ps(det_sub, det_sub, _MM_SHUFFLE(2, 2, 2, 2));
+	__m128 det_d = _mm_shuffle_ps(det_sub, det_sub, _MM_SHUFFLE(3, 3, 3, 3));
+
+	__m128 d_c = Matrix2x2AdjMul(d, c);
+	__m128 a_b = Matrix2x2AdjMul(a, b);
+
+	//the adjugates of the blocks of the inverse
+	__m128 x = _mm_sub_ps(_mm_mul_ps(det_d, a), Matrix2x2Mul(b, d_c));
+	__m128 w = _mm_sub_ps(_mm_mul_ps(det_a, d), Matrix2x2Mul(c, a_b));
+	__m128 y = _mm_sub_ps(_mm_mul_ps(det_b, c), Matrix2x2MulAdj(d, a_b));
+	__m128 z = _mm_sub_ps(_mm_mul_ps(det_c, b), Matrix2x2MulAdj(a, d_c));
+
+	//|M| = |A||D| + |B||C| - tr(adj(A) B adj(D) C)
+	__m128 trace = _mm_mul_ps(a_b, _mm_shuffle_ps(d_c, d_c, _MM_SHUFFLE(3, 1, 2, 0)));
+	trace = _mm_add_ps(trace, _mm_movehl_ps(trace, trace));
+	trace = _mm_add_ss(trace, _mm_shuffle_ps(trace, trace, _MM_SHUFFLE(1, 1, 1, 1)));
+
+	__m128 det = _mm_sub_ss(_mm_add_ss(_mm_mul_ss(det_a, det_d), _mm_mul_ss(det_b, det_c)), trace);
+	if (_mm_cvtss_f32(det) == 0)
+	{
+		return ZeroMatrix4x4<float>();
+	}
+
+	//the adjugate signs of the blocks go into 1 / |M|
+	__m128 inv_det = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), _mm_shuffle_ps(det, det, _MM_SHUFFLE(0, 0, 0, 0)));
+	x = _mm_mul_ps(x, inv_det);
+	y = _mm_mul_ps(y, inv_det);
+	z = _mm_mul_ps(z, inv_det);
+	w = _mm_mul_ps(w, inv_det);
+
+	Matrix4x4<float> mat;
+	mat.SetRow(0, _mm_shuffle_ps(x, y, _MM_SHUFFLE(1, 3, 1, 3)));
+	mat.SetRow(1, _mm_shuffle_ps(x, y, _MM_SHUFFLE(0, 2, 0, 2)));
+	mat.SetRow(2, _mm_shuffle_ps(z, w, _MM_SHUFFLE(1, 3, 1, 3)));
+	mat.SetRow(3, _mm_shuffle_ps(z, w, _MM_SHUFFLE(0, 2, 0, 2)));
+	return mat;
+}
+
+template<>
+inline Matrix4x4<float> Matrix4x4Transpose(const Matrix4x4<float> &m)
+{
+	__m128 row0 = m.Row(0), row1 = m.Row(1), row2 = m.Row(2), row3 = m.Row(3);
+	_MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+
+	Matrix4x4<float> mat;
+	mat.SetRow(0, row0);
+	mat.SetRow(1, row1);
+	mat.SetRow(2, row2);
+	mat.SetRow(3, row3);
+	return mat;
+}
+
 template<typename T>
 Matrix4x4<T> Matrix4x4Translation(const T &x, const T &y, const T &z)
 {
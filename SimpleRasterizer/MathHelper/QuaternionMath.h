@@ -129,5 +129,32 @@ Vec4<T> QuaternionSlerp(const Vec4<T> &quater0, const Vec4<T> &quater1, const T
 	return (quater0 * std::sin((1 - t) * theta) + short_q1 * std::sin(t * theta) ) / sin_theta;
 }
 
+//|q0 - q1|^2 > |q0 + q1|^2 is Dot(q0, q1) < 0, so one dot product picks the short arc and gives its cosine
+template<>
+inline Vec4<float> QuaternionSlerp(const Vec4<float> &quater0, const Vec4<float> &quater1, const float &t)
+{
+	__m128 q0 = quater0.Load();
+	__m128 short_q1 = quater1.Load();
+
+	float cos_theta = Dot(quater0, quater1);
+	if (cos_theta < 0)
+	{
+		cos_theta = -cos_theta;
+		short_q1 = _mm_xor_ps(short_q1, _mm_set1_ps(-0.0f));
+	}
+
+	if (cos_theta > (1.0f - 0.001f))
+	{
+		return Normalize(Vec4<float>(_mm_add_ps(_mm_mul_ps(q0, _mm_set1_ps(1 - t)), _mm_mul_ps(short_q1, _mm_set1_ps(t)))));
+	}
+
+	float theta = std::acos(cos_theta);
+
+	float sin_theta = std::sin(theta);
+
+	return Vec4<float>(_mm_add_ps(_mm_mul_ps(q0, _mm_set1_ps(std::sin((1 - t) * theta) / sin_theta)),
+		_mm_mul_ps(short_q1, _mm_set1_ps(std::sin(t * theta) / sin_theta))));
+}
+
 //chayige slerp
 #endif // !QUATERNIONMATH_H
\ No newline at end of file
@@ -5,5 +5,6 @@
 #include "VecotrMath.h"
 #include "QuaternionMath.h"
 #include "ScalarMath.h"
+#include "WideVector.h"
 
 #endif // !RENDERMATH_H
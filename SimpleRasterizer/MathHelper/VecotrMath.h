@@ -30,6 +30,12 @@ Vec4<T> Transform(const Vec4<T> &v, const Matrix4x4<T> &m)
 	return temp;
 }
 
+template<>
+inline Vec4<float> Transform(const Vec4<float> &v, const Matrix4x4<float> &m)
+{
+	return Vec4<float>(m.TransformRow(v.Load()));
+}
+
 template<typename T>
 Vec3<T> Vec3TransformNormal(const Vec3<T> &v, const Matrix4x4<T> &m)
 {
@@ -2,6 +2,7 @@
 #ifndef VECTOR_H
 #define VECTOR_H
 #include "PCH.h"
+#include <emmintrin.h>
 
 template<typename T>
 static inline void Swap(T &a, T &b)
@@ -570,6 +571,146 @@ struct Vec4
 	}
 };
 
+/*-------------*/
+/* Vec4<float> */
+/*-------------*/
+//same members as Vec4<T>, the math runs on one sse register.
+//the floats keep their 4 byte alignment because Vertex, Fragment, images and buffers store Vec4f inside packed float data,
+//so the register is loaded and stored unaligned
+template<>
+struct Vec4<float>
+{
+	union
+	{
+		struct { float x, y, z, w; };
+		struct { float r, g, b, a; };
+		float data[4];
+	};
+
+	/*--------------*/
+	/* Constructors */
+	/*--------------*/
+	//one 16 byte store, a wide load right after 4 float stores could not be forwarded from them
+	Vec4() {};
+	Vec4(const float &_x) { _mm_storeu_ps(data, _mm_set1_ps(_x)); };
+	Vec4(const float &_x, const float &_y, const float &_z, const float &_w) { _mm_storeu_ps(data, _mm_setr_ps(_x, _y, _z, _w)); };
+	Vec4(const float *t) { _mm_storeu_ps(data, _mm_loadu_ps(t)); };
+	explicit Vec4(const __m128 &v) { _mm_storeu_ps(data, v); };
+
+	__m128 Load() const { return _mm_loadu_ps(data); }
+	void Store(const __m128 &v) { _mm_storeu_ps(data, v); }
+
+	//x + y + z + w in the order the scalar code adds them, so dot products round the same
+	static float HorizontalAdd(const __m128 &v)
+	{
+		__m128 sum = _mm_add_ss(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)));
+		sum = _mm_add_ss(sum, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2)));
+		sum = _mm_add_ss(sum, _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3)));
+		return _mm_cvtss_f32(sum);
+	}
+
+	/*-------------------*/
+	/* Basic Vector Math */
+	/*-------------------*/
+	Vec4 operator + (const Vec4 &rhs) const
+	{
+		return Vec4(_mm_add_ps(Load(), rhs.Load()));
+	}
+
+	Vec4 operator - (const Vec4 &rhs) const
+	{
+		return Vec4(_mm_sub_ps(Load(), rhs.Load()));
+	}
+
+	const Vec4 &operator += (const Vec4 &rhs)
+	{
+		Store(_mm_add_ps(Load(), rhs.Load()));
+		return *this;
+	}
+
+	const Vec4 &operator -= (const Vec4 &rhs)
+	{
+		Store(_mm_sub_ps(Load(), rhs.Load()));
+		return *this;
+	}
+
+	/*-------------------*/
+	/* Basic Scalar Math */
+	/*-------------------*/
+	Vec4 operator + (const float &rhs) const
+	{
+		return Vec4(_mm_add_ps(Load(), _mm_set1_ps(rhs)));
+	}
+
+	Vec4 operator - (const float &rhs) const
+	{
+		return Vec4(_mm_sub_ps(Load(), _mm_set1_ps(rhs)));
+	}
+
+	Vec4 operator * (const float &rhs) const
+	{
+		return Vec4(_mm_mul_ps(Load(), _mm_set1_ps(rhs)));
+	}
+
+	Vec4 operator / (const float &rhs) const
+	{
+		return Vec4(_mm_div_ps(Load(), _mm_set1_ps(rhs)));
+	}
+
+	const Vec4 &operator += (const float &rhs)
+	{
+		Store(_mm_add_ps(Load(), _mm_set1_ps(rhs)));
+		return *this;
+	}
+
+	const Vec4 &operator -= (const float &rhs)
+	{
+		Store(_mm_sub_ps(Load(), _mm_set1_ps(rhs)));
+		return *this;
+	}
+
+	const Vec4 &operator *= (const float &rhs)
+	{
+		Store(_mm_mul_ps(Load(), _mm_set1_ps(rhs)));
+		return *this;
+	}
+
+	const Vec4 &operator /= (const float &rhs)
+	{
+		Store(_mm_div_ps(Load(), _mm_set1_ps(rhs)));
+		return *this;
+	}
+
+	/*------------*/
+	/* Other Math */
+	/*------------*/
+	bool operator == (const Vec4 &rhs) const
+	{
+		return _mm_movemask_ps(_mm_cmpeq_ps(Load(), rhs.Load())) == 0xf;
+	}
+
+	bool operator != (const Vec4 &rhs) const
+	{
+		return !(*this == rhs);
+	}
+
+	float LengthSq() const
+	{
+		__m128 v = Load();
+		return HorizontalAdd(_mm_mul_ps(v, v));
+	}
+
+	float Length() const
+	{
+		return sqrt(LengthSq());
+	}
+
+	void Normalize()
+	{
+		*this /= Length();
+	}
+};
+
 /*-----------------------*/
 /* Vec4 Nomenberfunction */
 /*-----------------------*/
@@ -592,6 +733,18 @@ inline Vec4<U> Normalize(const Vec4<U> &rhs)
 	return rhs / len;
 }
 
+template<>
+inline float Dot(const Vec4<float> &lhs, const Vec4<float> &rhs)
+{
+	return Vec4<float>::HorizontalAdd(_mm_mul_ps(lhs.Load(), rhs.Load()));
+}
+
+template<>
+inline Vec4<float> Mul(const Vec4<float> &lhs, const Vec4<float> &rhs)
+{
+	return Vec4<float>(_mm_mul_ps(lhs.Load(), rhs.Load()));
+}
+
 template<typename T>
 std::ostream& operator<<(std::ostream &lhs, const Vec4<T> &rhs)
 {
@@ -0,0 +1,343 @@
+#pragma once
+#ifndef WIDEVECTOR_H
+#define WIDEVECTOR_H
+#include "PCH.h"
+#include "Vector.h"
+#include "Matrix.h"
+#include <emmintrin.h>
+
+//eight floats worked on together, one per lane of a fragment packet.
+//two sse registers, so shaders written with it run on every x86 cpu without a dispatch
+struct Float8
+{
+	__m128 m_value[2];
+
+	/*--------------*/
+	/* Constructors */
+	/*--------------*/
+	Float8() {};
+	Float8(const float &pValue)
+	{
+		m_value[0] = m_value[1] = _mm_set1_ps(pValue);
+	}
+	Float8(const __m128 &pLow, const __m128 &pHigh)
+	{
+		m_value[0] = pLow;
+		m_value[1] = pHigh;
+	}
+
+	static Float8 Load(const float *pData)
+	{
+		return Float8(_mm_loadu_ps(pData), _mm_loadu_ps(pData + 4));
+	}
+
+	void Store(float *pData) const
+	{
+		_mm_storeu_ps(pData, m_value[0]);
+		_mm_storeu_ps(pData + 4, m_value[1]);
+	}
+
+	/*------*/
+	/* Math */
+	/*------*/
+	Float8 operator + (const Float8 &rhs) const
+	{
+		return Float8(_mm_add_ps(m_value[0], rhs.m_value[0]), _mm_add_ps(m_value[1], rhs.m_value[1]));
+	}
+
+	Float8 operator - (const Float8 &rhs) const
+	{
+		return Float8(_mm_sub_ps(m_value[0], rhs.m_value[0]), _mm_sub_ps(m_value[1], rhs.m_value[1]));
+	}
+
+	Float8 operator * (const Float8 &rhs) const
+	{
+		return Float8(_mm_mul_ps(m_value[0], rhs.m_value[0]), _mm_mul_ps(m_value[1], rhs.m_value[1]));
+	}
+
+	Float8 operator / (const Float8 &rhs) const
+	{
+		return Float8(_mm_div_ps(m_value[0], rhs.m_value[0]), _mm_div_ps(m_value[1], rhs.m_value[1]));
+	}
+
+	Float8 operator - () const
+	{
+		return Float8(0.0f) - *this;
+	}
+
+	const Float8 &operator += (const Float8 &rhs)
+	{
+		*this = *this + rhs;
+		return *this;
+	}
+
+	const Float8 &operator *= (const Float8 &rhs)
+	{
+		*this = *this * rhs;
+		return *this;
+	}
+
+	/*-------------*/
+	/* Comparisons */
+	/*-------------*/
+	//every bit of a lane is set where the comparison holds, the result is a mask for VectorSelect
+	Float8 operator < (const Float8 &rhs) const
+	{
+		return Float8(_mm_cmplt_ps(m_value[0], rhs.m_value[0]), _mm_cmplt_ps(m_value[1], rhs.m_value[1]));
+	}
+
+	Float8 operator > (const Float8 &rhs) const
+	{
+		return Float8(_mm_cmpgt_ps(m_value[0], rhs.m_value[0]), _mm_cmpgt_ps(m_value[1], rhs.m_value[1]));
+	}
+
+	Float8 operator & (const Float8 &rhs) const
+	{
+		return Float8(_mm_and_ps(m_value[0], rhs.m_value[0]), _mm_and_ps(m_value[1], rhs.m_value[1]));
+	}
+
+	//bit k is set when lane k of a mask is
+	int MoveMask() const
+	{
+		return _mm_movemask_ps(m_value[0]) | (_mm_movemask_ps(m_value[1]) << 4);
+	}
+};
+
+/*-------------------------*/
+/* Float8 Nomenberfunction */
+/*-------------------------*/
+inline Float8 VectorSelect(const Float8 &pMask, const Float8 &pTrue, const Float8 &pFalse)
+{
+	return Float8(_mm_or_ps(_mm_and_ps(pMask.m_value[0], pTrue.m_value[0]), _mm_andnot_ps(pMask.m_value[0], pFalse.m_value[0])),
+		_mm_or_ps(_mm_and_ps(pMask.m_value[1], pTrue.m_value[1]), _mm_andnot_ps(pMask.m_value[1], pFalse.m_value[1])));
+}
+
+inline Float8 VectorMax(const Float8 &lhs, const Float8 &rhs)
+{
+	return Float8(_mm_max_ps(lhs.m_value[0], rhs.m_value[0]), _mm_max_ps(lhs.m_value[1], rhs.m_value[1]));
+}
+
+inline Float8 VectorMin(const Float8 &lhs, const Float8 &rhs)
+{
+	return Float8(_mm_min_ps(lhs.m_value[0], rhs.m_value[0]), _mm_min_ps(lhs.m_value[1], rhs.m_value[1]));
+}
+
+inline Float8 VectorSqrt(const Float8 &v)
+{
+	return Float8(_mm_sqrt_ps(v.m_value[0]), _mm_sqrt_ps(v.m_value[1]));
+}
+
+inline Float8 VectorAbs(const Float8 &v)
+{
+	__m128 sign = _mm_set1_ps(-0.0f);
+	return Float8(_mm_andnot_ps(sign, v.m_value[0]), _mm_andnot_ps(sign, v.m_value[1]));
+}
+
+//v must be positive. the exponent is taken from the bits, the mantissa is moved into [sqrt(2) / 2, sqrt(2)]
+//and its log is the series of atanh, which is below 1e-7 relative error there
+inline __m128 Log2(const __m128 &v)
+{
+	__m128i bits = _mm_castps_si128(v);
+	__m128i exponent = _mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127));
+	__m128 mantissa = _mm_or_ps(_mm_and_ps(v, _mm_castsi128_ps(_mm_set1_epi32(0x007fffff))), _mm_set1_ps(1.0f));
+
+	__m128 large = _mm_cmpgt_ps(mantissa, _mm_set1_ps(1.41421356f));
+	mantissa = _mm_or_ps(_mm_and_ps(large, _mm_mul_ps(mantissa, _mm_set1_ps(0.5f))), _mm_andnot_ps(large, mantissa));
+	__m128 e = _mm_add_ps(_mm_cvtepi32_ps(exponent), _mm_and_ps(large, _mm_set1_ps(1.0f)));
+
+	__m128 t = _mm_div_ps(_mm_sub_ps(mantissa, _mm_set1_ps(1.0f)), _mm_add_ps(mantissa, _mm_set1_ps(1.0f)));
+	__m128 t2 = _mm_mul_ps(t, t);
+
+	__m128 series = _mm_set1_ps(1.0f / 9.0f);
+	series = _mm_add_ps(_mm_mul_ps(series, t2), _mm_set1_ps(1.0f / 7.0f));
+	series = _mm_add_ps(_mm_mul_ps(series, t2), _mm_set1_ps(1.0f / 5.0f));
+	series = _mm_add_ps(_mm_mul_ps(series, t2), _mm_set1_ps(1.0f / 3.0f));
+	series = _mm_add_ps(_mm_mul_ps(series, t2), _mm_set1_ps(1.0f));
+
+	//ln(m) = 2 * t * series, log2(m) = ln(m) / ln(2)
+	return _mm_add_ps(e, _mm_mul_ps(_mm_mul_ps(t, series), _mm_set1_ps(2.0f * 1.44269504f)));
+}
+
+//v is split into the nearest integer, which goes into the exponent bits, and a rest in [-0.5, 0.5]
+//whose power is a taylor series of exp
+inline __m128 Exp2(const __m128 &v)
+{
+	__m128 clamped = _mm_min_ps(_mm_max_ps(v, _mm_set1_ps(-126.0f)), _mm_set1_ps(127.0f));
+	__m128i n = _mm_cvtps_epi32(clamped);
+	__m128 x = _mm_mul_ps(_mm_sub_ps(clamped, _mm_cvtepi32_ps(n)), _mm_set1_ps(0.693147181f));
+
+	__m128 series = _mm_set1_ps(1.0f / 720.0f);
+	series = _mm_add_ps(_mm_mul_ps(series, x), _mm_set1_ps(1.0f / 120.0f));
+	series = _mm_add_ps(_mm_mul_ps(series, x), _mm_set1_ps(1.0f / 24.0f));
+	series = _mm_add_ps(_mm_mul_ps(series, x), _mm_set1_ps(1.0f / 6.0f));
+	series = _mm_add_ps(_mm_mul_ps(series, x), _mm_set1_ps(0.5f));
+	series = _mm_add_ps(_mm_mul_ps(series, x), _mm_set1_ps(1.0f));
+	series = _mm_add_ps(_mm_mul_ps(series, x), _mm_set1_ps(1.0f));
+
+	__m128 scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(n, _mm_set1_epi32(127)), 23));
+	return _mm_mul_ps(series, scale);
+}
+
+//for v >= 0 like the base of a specular term, lanes where v is 0 give 0
+inline Float8 VectorPow(const Float8 &v, const Float8 &e)
+{
+	__m128 result[2];
+	for (int i = 0; i < 2; i++)
+	{
+		__m128 positive = _mm_cmpgt_ps(v.m_value[i], _mm_setzero_ps());
+		result[i] = _mm_and_ps(positive, Exp2(_mm_mul_ps(e.m_value[i], Log2(v.m_value[i]))));
+	}
+	return Float8(result[0], result[1]);
+}
+
+/*--------*/
+/* Vec2f8 */
+/*--------*/
+struct Vec2f8
+{
+	Float8 x, y;
+
+	Vec2f8() {};
+	Vec2f8(const Float8 &_x, const Float8 &_y) : x(_x), y(_y) {};
+	Vec2f8(const Vec2f &v) : x(v.x), y(v.y) {};
+};
+
+/*--------*/
+/* Vec3f8 */
+/*--------*/
+struct Vec3f8
+{
+	Float8 x, y, z;
+
+	Vec3f8() {};
+	Vec3f8(const float &_x) : x(_x), y(_x), z(_x) {};
+	Vec3f8(const Float8 &_x, const Float8 &_y, const Float8 &_z) : x(_x), y(_y), z(_z) {};
+	Vec3f8(const Vec3f &v) : x(v.x), y(v.y), z(v.z) {};
+
+	Vec3f8 operator + (const Vec3f8 &rhs) const
+	{
+		return Vec3f8(x + rhs.x, y + rhs.y, z + rhs.z);
+	}
+
+	Vec3f8 operator - (const Vec3f8 &rhs) const
+	{
+		return Vec3f8(x - rhs.x, y - rhs.y, z - rhs.z);
+	}
+
+	Vec3f8 operator * (const Float8 &rhs) const
+	{
+		return Vec3f8(x * rhs, y * rhs, z * rhs);
+	}
+
+	Vec3f8 operator / (const Float8 &rhs) const
+	{
+		return Vec3f8(x / rhs, y / rhs, z / rhs);
+	}
+
+	Float8 LengthSq() const
+	{
+		return x * x + y * y + z * z;
+	}
+
+	Float8 Length() const
+	{
+		return VectorSqrt(LengthSq());
+	}
+};
+
+inline Float8 Dot(const Vec3f8 &lhs, const Vec3f8 &rhs)
+{
+	return lhs.x * rhs.x + lhs.y * rhs.y + lhs.z * rhs.z;
+}
+
+inline Vec3f8 Cross(const Vec3f8 &lhs, const Vec3f8 &rhs)
+{
+	return Vec3f8(lhs.y * rhs.z - lhs.z * rhs.y,
+		lhs.z * rhs.x - lhs.x * rhs.z,
+		lhs.x * rhs.y - lhs.y * rhs.x);
+}
+
+inline Vec3f8 Normalize(const Vec3f8 &lhs)
+{
+	return lhs / lhs.Length();
+}
+
+inline Vec3f8 Mul(const Vec3f8 &lhs, const Vec3f8 &rhs)
+{
+	return Vec3f8(lhs.x * rhs.x, lhs.y * rhs.y, lhs.z * rhs.z);
+}
+
+inline Vec3f8 VectorReflect(const Vec3f8 &incident, const Vec3f8 &normal)
+{
+	return incident + normal * Dot(incident, normal) * -2.0f;
+}
+
+inline Vec3f8 VectorSelect(const Float8 &pMask, const Vec3f8 &pTrue, const Vec3f8 &pFalse)
+{
+	return Vec3f8(VectorSelect(pMask, pTrue.x, pFalse.x), VectorSelect(pMask, pTrue.y, pFalse.y), VectorSelect(pMask, pTrue.z, pFalse.z));
+}
+
+/*--------*/
+/* Vec4f8 */
+/*--------*/
+struct Vec4f8
+{
+	Float8 x, y, z, w;
+
+	Vec4f8() {};
+	Vec4f8(const float &_x) : x(_x), y(_x), z(_x), w(_x) {};
+	Vec4f8(const Float8 &_x, const Float8 &_y, const Float8 &_z, const Float8 &_w) : x(_x), y(_y), z(_z), w(_w) {};
+	Vec4f8(const Vec4f &v) : x(v.x), y(v.y), z(v.z), w(v.w) {};
+
+	Vec4f8 operator + (const Vec4f8 &rhs) const
+	{
+		return Vec4f8(x + rhs.x, y + rhs.y, z + rhs.z, w + rhs.w);
+	}
+
+	Vec4f8 operator - (const Vec4f8 &rhs) const
+	{
+		return Vec4f8(x - rhs.x, y - rhs.y, z - rhs.z, w - rhs.w);
+	}
+
+	Vec4f8 operator * (const Float8 &rhs) const
+	{
+		return Vec4f8(x * rhs, y * rhs, z * rhs, w * rhs);
+	}
+};
+
+inline Float8 Dot(const Vec4f8 &lhs, const Vec4f8 &rhs)
+{
+	return lhs.x * rhs.x + lhs.y * rhs.y + lhs.z * rhs.z + lhs.w * rhs.w;
+}
+
+inline Vec4f8 Mul(const Vec4f8 &lhs, const Vec4f8 &rhs)
+{
+	return Vec4f8(lhs.x * rhs.x, lhs.y * rhs.y, lhs.z * rhs.z, lhs.w * rhs.w);
+}
+
+inline Vec4f8 VectorSelect(const Float8 &pMask, const Vec4f8 &pTrue, const Vec4f8 &pFalse)
+{
+	return Vec4f8(VectorSelect(pMask, pTrue.x, pFalse.x), VectorSelect(pMask, pTrue.y, pFalse.y),
+		VectorSelect(pMask, pTrue.z, pFalse.z), VectorSelect(pMask, pTrue.w, pFalse.w));
+}
+
+inline Vec4f8 LoadVector3(const Vec3f8 &v)
+{
+	return Vec4f8(v.x, v.y, v.z, 0.0f);
+}
+//row-major like Transform of VecotrMath.h, each matrix element is broadcast so the 8 vectors share one matrix
+inline Vec4f8 Transform(const Vec4f8 &v, const Matrix4x4f &m)
+{
+	return Vec4f8(v.x * m[0][0] + v.y * m[1][0] + v.z * m[2][0] + v.w * m[3][0],
+		v.x * m[0][1] + v.y * m[1][1] + v.z * m[2][1] + v.w * m[3][1],
+		v.x * m[0][2] + v.y * m[1][2] + v.z * m[2][2] + v.w * m[3][2],
+		v.x * m[0][3] + v.y * m[1][3] + v.z * m[2][3] + v.w * m[3][3]);
+}
+
+inline Vec3f8 Vec3TransformNormal(const Vec3f8 &v, const Matrix4x4f &m)
+{
+	return Vec3f8(v.x * m[0][0] + v.y * m[1][0] + v.z * m[2][0],
+		v.x * m[0][1] + v.y * m[1][1] + v.z * m[2][1],
+		v.x * m[0][2] + v.y * m[1][2] + v.z * m[2][2]);
+}
+#endif // !WIDEVECTOR_H
@@ -52,6 +52,7 @@ int App::Run()
 				CalculateFPS();
 				Render(m_timer.GetDeltaSecondF());
 				m_swap_chain->Present();		
+				m_context->ResetScratchMemory();
 			}
 			
 			std::string fps_str = "FPS: " + std::to_string(m_fps);
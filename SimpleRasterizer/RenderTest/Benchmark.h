@@ -0,0 +1,342 @@
+#pragma once
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "PCH.h"
+#include "RenderInterface.h"
+
+//draws layers of full screen quads front to back of each other, so every layer passes the depth test
+//and every pixel of every layer is shaded and written to all render targets
+class FillRateBenchmark
+{
+public:
+	FillRateBenchmark(const size_t &pWidth = 600, const size_t &pHeight = 600, const size_t &pLayerNum = 8, const size_t &pFrameNum = 32) :
+		m_width(pWidth), m_height(pHeight), m_layer_num(pLayerNum), m_frame_num(pFrameNum)
+	{
+		ImageDesc color_desc(IMAGE_FORMAT::R8G8B8A8_UINT, m_width, m_height);
+		ImageDesc float_desc(IMAGE_FORMAT::R32G32B32A32_FLOAT, m_width, m_height);
+		ImageDesc depth_desc(IMAGE_FORMAT::R32_FLOAT, m_width, m_height);
+
+		m_targets[0] = m_device.CreateImage(color_desc, "benchmark_color");
+		m_targets[1] = m_device.CreateImage(float_desc, "benchmark_float");
+		m_depth = m_device.CreateImage(depth_desc, "benchmark_depth");
+
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+
+		//later layers are closer to the camera
+		for (size_t i = 0; i < m_layer_num; i++)
+		{
+			float z = 1.0f - static_cast<float>(i + 1) / static_cast<float>(m_layer_num + 1);
+			uint32_t base = static_cast<uint32_t>(vertices.size());
+
+			vertices.emplace_back(Vertex(-1.0f, -1.0f, z, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f));
+			vertices.emplace_back(Vertex(-1.0f, +1.0f, z, 0.0f, 0.0f, -1.0f, 0.0f, 0.0f));
+			vertices.emplace_back(Vertex(+1.0f, +1.0f, z, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f));
+			vertices.emplace_back(Vertex(+1.0f, -1.0f, z, 0.0f, 0.0f, -1.0f, 1.0f, 1.0f));
+
+			uint32_t quad[6] = { base, base + 1, base + 2, base, base + 2, base + 3 };
+			indices.insert(indices.end(), quad, quad + 6);
+		}
+
+		BufferDesc vertex_buffer_desc;
+		vertex_buffer_desc.m_stride = sizeof(Vertex);
+		vertex_buffer_desc.m_num_of_element = vertices.size();
+		vertex_buffer_desc.m_data = vertices.data();
+		vertex_buffer_desc.m_buffer_size = sizeof(Vertex) * vertices.size();
+		m_vertex_buffer = m_device.CreateBuffer(vertex_buffer_desc);
+
+		BufferDesc index_buffer_desc;
+		index_buffer_desc.m_stride = sizeof(uint32_t);
+		index_buffer_desc.m_num_of_element = indices.size();
+		index_buffer_desc.m_data = indices.data();
+		index_buffer_desc.m_buffer_size = sizeof(uint32_t) * indices.size();
+		m_index_buffer = m_device.CreateBuffer(index_buffer_desc);
+
+		Viewport port;
+		port.m_top_leftx = 0;
+		port.m_top_lefty = 0;
+		port.m_width = static_cast<float>(m_width);
+		port.m_height = static_cast<float>(m_height);
+		m_context.SetViewport(port);
+	}
+
+	void Run(std::ostream &pOut)
+	{
+		pOut << "fill rate " << m_width << "x" << m_height << ", " << m_layer_num << " layers, " << m_frame_num << " frames" << std::endl;
+
+		RunCase(pOut, "dynamic shaders", 2, [](Context3D &pContext) {
+			pContext.SetPipelineState(nullptr);
+			pContext.SetFragmentLayout(FragmentLayout::BASE);
+			pContext.SetVertexShader(VS);
+			pContext.SetFragmentShader(PS);
+		});
+
+		std::shared_ptr<PipelineState> pipeline = std::make_shared<BenchmarkPipeline>();
+		RunCase(pOut, "pipeline state", 2, [&](Context3D &pContext) {
+			pContext.SetPipelineState(pipeline);
+		});
+
+		RunCase(pOut, "dynamic packet shader", 2, [](Context3D &pContext) {
+			pContext.SetPipelineState(nullptr);
+			pContext.SetFragmentLayout(FragmentLayout::BASE);
+			pContext.SetVertexShader(VS);
+			pContext.SetPacketFragmentShader(PacketPS);
+		});
+		m_context.SetPacketFragmentShader(nullptr);
+	}
+
+	//binds the first pTargetNum benchmark targets, R8G8B8A8_UINT and then R32G32B32A32_FLOAT
+	void RunCase(std::ostream &pOut, const std::string &pName, const size_t &pTargetNum, const std::function<void(Context3D&)> &pBind)
+	{
+		m_context.SeteDepthBuffer(m_depth);
+		m_context.SetRenderTargets(m_targets, pTargetNum);
+		m_context.SetVertexBuffer(m_vertex_buffer);
+		m_context.SetIndexBuffer(m_index_buffer, INDEX_FORMAT::R32_UINT);
+		pBind(m_context);
+
+		//the first frames only warm up the arenas and the thread pool
+		for (size_t i = 0; i < 2; i++)
+		{
+			RenderFrame();
+		}
+
+		auto begin = std::chrono::high_resolution_clock::now();
+		for (size_t i = 0; i < m_frame_num; i++)
+		{
+			RenderFrame();
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+
+		m_context.UnbindRenderTargets();
+		m_context.UnbindDepthBuffer();
+
+		double seconds = std::chrono::duration<double>(end - begin).count();
+		double frame_ms = seconds * 1000.0 / m_frame_num;
+		double pixels = static_cast<double>(m_width * m_height * m_layer_num * m_frame_num);
+
+		pOut << pName << ": " << frame_ms << " ms/frame, " << pixels / seconds / 1000000.0 << " Mpixels/s" << std::endl;
+	}
+
+private:
+	static void VS(const Vertex &pVertexIn, Fragment &pVertexOut)
+	{
+		pVertexOut.m_pos = Vec4f(pVertexIn.m_pos.x, pVertexIn.m_pos.y, pVertexIn.m_pos.z, 1.0f);
+		pVertexOut.m_normal = pVertexIn.m_normal;
+		pVertexOut.m_uv = pVertexIn.m_uv;
+	}
+
+	static void PS(const Fragment &pFragmentIn, Vec4f **pFragmentOut)
+	{
+		(*pFragmentOut)[0] = Vec4f(pFragmentIn.m_uv.x, pFragmentIn.m_uv.y, pFragmentIn.m_pos.z, 1.0f);
+		(*pFragmentOut)[1] = Vec4f(pFragmentIn.m_normal.x, pFragmentIn.m_normal.y, pFragmentIn.m_normal.z, pFragmentIn.m_pos.z);
+	}
+
+	static void PacketPS(const FragmentPacket &pPacketIn, FragmentPacketOut *pPacketOut)
+	{
+		Vec2f8 uv = LoadPacketVector2(pPacketIn, UVVarying::offset);
+		Vec3f8 normal = LoadPacketVector3(pPacketIn, NormalVarying::offset);
+		Float8 z = LoadPacketScalar(pPacketIn, zPlane);
+
+		StorePacketVector4(pPacketOut[0], Vec4f8(uv.x, uv.y, z, 1.0f));
+		StorePacketVector4(pPacketOut[1], Vec4f8(normal.x, normal.y, normal.z, z));
+	}
+
+	struct VSFun
+	{
+		void operator()(const Vertex &pVertexIn, Fragment &pVertexOut) const
+		{
+			VS(pVertexIn, pVertexOut);
+		}
+	};
+
+	struct PSFun
+	{
+		void operator()(const Fragment &pFragmentIn, Vec4f **pFragmentOut) const
+		{
+			PS(pFragmentIn, pFragmentOut);
+		}
+	};
+
+	using BenchmarkPipeline = Pipeline<VSFun, PSFun, BaseVaryings, IMAGE_FORMAT::R8G8B8A8_UINT, IMAGE_FORMAT::R32G32B32A32_FLOAT>;
+
+	void RenderFrame()
+	{
+		m_context.ClearDepthBuffer();
+		m_context.Draw();
+		m_context.ResetScratchMemory();
+	}
+
+	size_t m_width;
+	size_t m_height;
+	size_t m_layer_num;
+	size_t m_frame_num;
+
+	Device3D m_device;
+	Context3D m_context;
+
+	std::shared_ptr<Image> m_targets[2];
+	std::shared_ptr<Image> m_depth;
+	std::shared_ptr<Buffer> m_vertex_buffer;
+	std::shared_ptr<Buffer> m_index_buffer;
+};
+
+//a grid of pGridSize x pGridSize vertices behind the near plane, every triangle is rejected by its clip codes
+//so the frame time is vertex shading and triangle assembly
+class VertexRateBenchmark
+{
+public:
+	VertexRateBenchmark(const size_t &pGridSize = 1024, const size_t &pFrameNum = 16) : m_grid_size(pGridSize), m_frame_num(pFrameNum)
+	{
+		ImageDesc color_desc(IMAGE_FORMAT::R8G8B8A8_UINT, 64, 64);
+		ImageDesc depth_desc(IMAGE_FORMAT::R32_FLOAT, 64, 64);
+
+		m_target = m_device.CreateImage(color_desc, "vertex_benchmark_color");
+		m_depth = m_device.CreateImage(depth_desc, "vertex_benchmark_depth");
+
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+		vertices.reserve(m_grid_size * m_grid_size);
+		indices.reserve((m_grid_size - 1) * (m_grid_size - 1) * 6);
+
+		float grid_scale = 1.0f / static_cast<float>(m_grid_size - 1);
+		for (size_t y = 0; y < m_grid_size; y++)
+		{
+			for (size_t x = 0; x < m_grid_size; x++)
+			{
+				float u = static_cast<float>(x) * grid_scale;
+				float v = static_cast<float>(y) * grid_scale;
+				vertices.emplace_back(Vertex(u * 2.0f - 1.0f, 1.0f - v * 2.0f, 0.5f, 0.0f, 0.0f, -1.0f, u, v));
+			}
+		}
+
+		for (size_t y = 0; y + 1 < m_grid_size; y++)
+		{
+			for (size_t x = 0; x + 1 < m_grid_size; x++)
+			{
+				uint32_t base = static_cast<uint32_t>(y * m_grid_size + x);
+				uint32_t row = static_cast<uint32_t>(m_grid_size);
+				uint32_t quad[6] = { base, base + 1, base + row + 1, base, base + row + 1, base + row };
+				indices.insert(indices.end(), quad, quad + 6);
+			}
+		}
+
+		BufferDesc vertex_buffer_desc;
+		vertex_buffer_desc.m_stride = sizeof(Vertex);
+		vertex_buffer_desc.m_num_of_element = vertices.size();
+		vertex_buffer_desc.m_data = vertices.data();
+		vertex_buffer_desc.m_buffer_size = sizeof(Vertex) * vertices.size();
+		m_vertex_buffer = m_device.CreateBuffer(vertex_buffer_desc);
+
+		BufferDesc index_buffer_desc;
+		index_buffer_desc.m_stride = sizeof(uint32_t);
+		index_buffer_desc.m_num_of_element = indices.size();
+		index_buffer_desc.m_data = indices.data();
+		index_buffer_desc.m_buffer_size = sizeof(uint32_t) * indices.size();
+		m_index_buffer = m_device.CreateBuffer(index_buffer_desc);
+
+		Viewport port;
+		port.m_top_leftx = 0;
+		port.m_top_lefty = 0;
+		port.m_width = 64.0f;
+		port.m_height = 64.0f;
+		m_context.SetViewport(port);
+
+		//a world and a view projection transform like the demo, the second one moves the grid behind the camera
+		m_world = IdentityMatrix4x4<float>();
+		m_world[0][0] = 0.5f;
+		m_world[1][1] = 0.5f;
+		m_view_proj = IdentityMatrix4x4<float>();
+		m_view_proj[3][2] = -2.0f;
+	}
+
+	void Run(std::ostream &pOut)
+	{
+		pOut << "vertex rate " << m_grid_size * m_grid_size << " vertices, " << m_frame_num << " frames" << std::endl;
+
+		RunCase(pOut, "vertex shader", [this](Context3D &pContext) {
+			pContext.SetVertexShader([this](const Vertex &pVertexIn, Fragment &pVertexOut) { VS(pVertexIn, pVertexOut); });
+		});
+
+		RunCase(pOut, "batch vertex shader", [this](Context3D &pContext) {
+			pContext.SetBatchVertexShader([this](const VertexBatch &pVertexIn, VertexBatchOut &pVertexOut) { BatchVS(pVertexIn, pVertexOut); });
+		});
+		m_context.SetBatchVertexShader(nullptr);
+	}
+
+private:
+	void VS(const Vertex &pVertexIn, Fragment &pVertexOut) const
+	{
+		Vec4f posW = Transform(Vec4f(pVertexIn.m_pos.x, pVertexIn.m_pos.y, pVertexIn.m_pos.z, 1.0f), m_world);
+		pVertexOut.m_pos = Transform(posW, m_view_proj);
+		pVertexOut.m_normal = Vec3TransformNormal(pVertexIn.m_normal, m_world);
+		pVertexOut.m_uv = pVertexIn.m_uv;
+		pVertexOut.pack0 = posW;
+	}
+
+	void BatchVS(const VertexBatch &pVertexIn, VertexBatchOut &pVertexOut) const
+	{
+		Vec3f8 pos = LoadBatchVector3(pVertexIn, vertexPosOffset);
+		Vec4f8 posW = Transform(Vec4f8(pos.x, pos.y, pos.z, 1.0f), m_world);
+		StoreBatchPosition(pVertexOut, Transform(posW, m_view_proj));
+		StoreBatchVector3(pVertexOut, NormalVarying::offset, Vec3TransformNormal(LoadBatchVector3(pVertexIn, vertexNormalOffset), m_world));
+		StoreBatchVector2(pVertexOut, UVVarying::offset, LoadBatchVector2(pVertexIn, vertexUVOffset));
+		StoreBatchVector4(pVertexOut, Pack0Varying::offset, posW);
+	}
+
+	static void PS(const Fragment &, Vec4f **pFragmentOut)
+	{
+		(*pFragmentOut)[0] = Vec4f(1.0f);
+	}
+
+	void RunCase(std::ostream &pOut, const std::string &pName, const std::function<void(Context3D&)> &pBind)
+	{
+		m_context.SeteDepthBuffer(m_depth);
+		m_context.SetRenderTargets(&m_target, 1);
+		m_context.SetVertexBuffer(m_vertex_buffer);
+		m_context.SetIndexBuffer(m_index_buffer, INDEX_FORMAT::R32_UINT);
+		m_context.SetPipelineState(nullptr);
+		m_context.SetFragmentLayout(FragmentLayout::EXTENSION0);
+		m_context.SetFragmentShader(PS);
+		pBind(m_context);
+
+		RenderFrame();
+
+		auto begin = std::chrono::high_resolution_clock::now();
+		for (size_t i = 0; i < m_frame_num; i++)
+		{
+			RenderFrame();
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+
+		m_context.UnbindRenderTargets();
+		m_context.UnbindDepthBuffer();
+
+		double seconds = std::chrono::duration<double>(end - begin).count();
+		double frame_ms = seconds * 1000.0 / m_frame_num;
+		double vertices = static_cast<double>(m_grid_size * m_grid_size * m_frame_num);
+
+		pOut << pName << ": " << frame_ms << " ms/frame, " << vertices / seconds / 1000000.0 << " Mvertices/s" << std::endl;
+	}
+
+	void RenderFrame()
+	{
+		m_context.ClearDepthBuffer();
+		m_context.Draw();
+		m_context.ResetScratchMemory();
+	}
+
+	size_t m_grid_size;
+	size_t m_frame_num;
+	Matrix4x4f m_world;
+	Matrix4x4f m_view_proj;
+
+	Device3D m_device;
+	Context3D m_context;
+
+	std::shared_ptr<Image> m_target;
+	std::shared_ptr<Image> m_depth;
+	std::shared_ptr<Buffer> m_vertex_buffer;
+	std::shared_ptr<Buffer> m_index_buffer;
+};
+#endif // !BENCHMARK_H
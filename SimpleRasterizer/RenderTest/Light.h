@@ -41,4 +41,23 @@ void ComputeDirectionalLight(const Material &pMat, const DirectionalLight &pLigh
 	}
 }
 
+//the same for the lanes of a packet, lanes facing away from the light keep their diffuse and specular
+void ComputeDirectionalLight(const Material &pMat, const DirectionalLight &pLight, const Vec3f8 &pNormal,
+	const Vec3f8 &pToEye, Vec4f8 &pAmbient, Vec4f8 &pDiffuse, Vec4f8 &pSpec)
+{
+	Vec3f8 light_dir = pLight.m_direction * -1.0f;
+
+	pAmbient = Mul(pMat.m_ambient, pLight.m_ambient);
+
+	Float8 diffuse_factor = Dot(light_dir, pNormal);
+	Float8 lit = diffuse_factor > 0.0f;
+
+	Vec3f8 v = VectorReflect(Vec3f8(pLight.m_direction), pNormal);
+
+	Float8 spec_factor = VectorPow(VectorMax(Dot(v, pToEye), 0.0f), pMat.m_specular.w);
+
+	pDiffuse = VectorSelect(lit, Vec4f8(Mul(pMat.m_diffuse, pLight.m_diffuse)) * diffuse_factor, pDiffuse);
+	pSpec = VectorSelect(lit, Vec4f8(Mul(pMat.m_specular, pLight.m_specular)) * spec_factor, pSpec);
+}
+
 #endif // !LIGHT_H
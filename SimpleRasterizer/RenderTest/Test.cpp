@@ -6,6 +6,7 @@
 #include "App.h"
 #include "ImageHelper.h"
 #include "Light.h"
+#include "Benchmark.h"
 
 struct KeyFrame
 {
@@ -89,6 +90,25 @@ struct ShaderStruct
 	};
 
 	static ConstBuffer buffer;
+	//the context drawing with these shaders, the diffuse map is its shader resource 0
+	static const Context3D *context;
+
+	inline static void SetLighting()
+	{
+		DirectionalLight light;
+		light.m_ambient = Vec4f(0.1f, 0.1f, 0.1f, 1.0f);
+		light.m_diffuse = Vec4f(0.8f, 0.8f, 0.8f, 1.0f);
+		light.m_specular = Vec4f(0.5f, 0.5, 0.5, 1.0f);
+		light.m_direction = Vec3f(0.57735f, -0.57735f, 0.57735f);
+
+		Material mat;
+		mat.m_ambient = Vec4f(0.5f, 0.5f, 0.5f, 1.0f);
+		mat.m_diffuse = Vec4f(0.8f, 0.2f, 0.4f, 1.0f);
+		mat.m_specular = Vec4f(0.2f, 0.2f, 0.2f, 16.0f);
+
+		buffer.light = light;
+		buffer.mat = mat;
+	}
 
 	inline static void VS(const Vertex &pVertexIn, Fragment &pVertexOut)
 	{
@@ -100,9 +120,20 @@ struct ShaderStruct
 		pVertexOut.pack0 = posW;
 	}
 
+	//VS for 8 vertices at once
+	inline static void BatchVS(const VertexBatch &pVertexIn, VertexBatchOut &pVertexOut)
+	{
+		Vec3f8 pos = LoadBatchVector3(pVertexIn, vertexPosOffset);
+		Vec4f8 posW = Transform(Vec4f8(pos.x, pos.y, pos.z, 1.0f), buffer.world);
+		StoreBatchPosition(pVertexOut, Transform(posW, buffer.view_proj));
+		StoreBatchVector3(pVertexOut, NormalVarying::offset, Vec3TransformNormal(LoadBatchVector3(pVertexIn, vertexNormalOffset), buffer.world_inv_trans));
+		StoreBatchVector2(pVertexOut, UVVarying::offset, LoadBatchVector2(pVertexIn, vertexUVOffset));
+		StoreBatchVector4(pVertexOut, Pack0Varying::offset, posW);
+	}
+
 	inline static void PS(const Fragment &pFragmentIn, Vec4f **pFragmentOut)
 	{
-		Vec4f tex_diff = LoadVector3(SampleTexturePoint<Vec3f>(App::GetContext()->GetShaderResource(0), pFragmentIn.m_uv));
+		Vec4f tex_diff = LoadVector3(SampleTexturePoint<Vec3f>(context->GetShaderResource(0), pFragmentIn.m_uv));
 
 		Vec4f ambient = Vec4f(0.0f);
 		Vec4f diffuse = Vec4f(0.0f);
@@ -115,9 +146,64 @@ struct ShaderStruct
 		Vec4f color = Mul(ambient + diffuse, tex_diff) + spec;
 		(*pFragmentOut)[0] = color ;
 	}
+
+	//PS for the 8 lanes of a packet at once
+	inline static void PacketPS(const FragmentPacket &pPacketIn, FragmentPacketOut *pPacketOut)
+	{
+		const ExtensionImage<Vec3f> &diffuse_map = static_cast<const ExtensionImage<Vec3f>&>(*context->GetShaderResource(0));
+		Vec4f8 tex_diff = LoadVector3(SampleTexturePoint(diffuse_map, LoadPacketVector2(pPacketIn, UVVarying::offset), pPacketIn.m_mask));
+
+		Vec4f8 ambient = Vec4f8(0.0f);
+		Vec4f8 diffuse = Vec4f8(0.0f);
+		Vec4f8 spec = Vec4f8(0.0f);
+
+		Vec3f8 toeye = Normalize(Vec3f8(buffer.eye_posw) - LoadPacketVector3(pPacketIn, Pack0Varying::offset));
+
+		ComputeDirectionalLight(buffer.mat, buffer.light, Normalize(LoadPacketVector3(pPacketIn, NormalVarying::offset)), toeye, ambient, diffuse, spec);
+
+		Vec4f8 color = Mul(ambient + diffuse, tex_diff) + spec;
+		StorePacketVector4(pPacketOut[0], color);
+	}
+
+	struct VSFun
+	{
+		void operator()(const Vertex &pVertexIn, Fragment &pVertexOut) const
+		{
+			VS(pVertexIn, pVertexOut);
+		}
+	};
+
+	struct BatchVSFun
+	{
+		void operator()(const VertexBatch &pVertexIn, VertexBatchOut &pVertexOut) const
+		{
+			BatchVS(pVertexIn, pVertexOut);
+		}
+	};
+
+	struct PSFun
+	{
+		void operator()(const Fragment &pFragmentIn, Vec4f **pFragmentOut) const
+		{
+			PS(pFragmentIn, pFragmentOut);
+		}
+	};
+
+	struct PacketPSFun
+	{
+		void operator()(const FragmentPacket &pPacketIn, FragmentPacketOut *pPacketOut) const
+		{
+			PacketPS(pPacketIn, pPacketOut);
+		}
+	};
 };
 
+using ShaderPipeline = Pipeline<ShaderStruct::VSFun, ShaderStruct::PSFun, Extension0Varyings, IMAGE_FORMAT::R8G8B8A8_UINT>;
+using PacketShaderPipeline = Pipeline<ShaderStruct::VSFun, ShaderStruct::PacketPSFun, Extension0Varyings, IMAGE_FORMAT::R8G8B8A8_UINT>;
+using BatchShaderPipeline = Pipeline<ShaderStruct::BatchVSFun, ShaderStruct::PacketPSFun, Extension0Varyings, IMAGE_FORMAT::R8G8B8A8_UINT>;
+
 ShaderStruct::ConstBuffer ShaderStruct::buffer;
+const Context3D *ShaderStruct::context = nullptr;
 
 class SimpleApp : public App
 {
@@ -187,7 +273,7 @@ protected:
 		v[23] = Vertex(+w2, -h2, +d2, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f);
 
 
-		size_t i[36];
+		uint16_t i[36];
 
 		// Index
 		i[0] = 0; i[1] = 1; i[2] = 2;
@@ -217,10 +303,10 @@ protected:
 		m_vertex_buffer = m_device->CreateBuffer(vertex_buffer_desc);
 
 		BufferDesc index_buffer_desc;
-		index_buffer_desc.m_stride = sizeof(size_t);
+		index_buffer_desc.m_stride = sizeof(uint16_t);
 		index_buffer_desc.m_num_of_element = 36;
 		index_buffer_desc.m_data = i;
-		index_buffer_desc.m_buffer_size = sizeof(size_t) * 36;
+		index_buffer_desc.m_buffer_size = sizeof(uint16_t) * 36;
 
 		m_index_buffer = m_device->CreateBuffer(index_buffer_desc);
 
@@ -231,6 +317,7 @@ protected:
 
 		m_depth_image = m_device->CreateImage(depth_image_desc);
 		m_color_image = ReadPPMImage("RenderTest\\kugga.ppm");
+		ShaderStruct::context = m_context.get();
 
 		Viewport port;
 		port.m_top_leftx = 0;
@@ -239,6 +326,8 @@ protected:
 		port.m_height = static_cast<float>(m_swap_chain->GetBackBufferHeight());
 
 		m_context->SetViewport(port);
+
+		m_pipeline_state = std::make_shared<BatchShaderPipeline>();
 		
 		m_anima.m_frames.reserve(5);
 
@@ -280,19 +369,7 @@ protected:
 
 		m_anima_time = 0;
 
-		DirectionalLight light;
-		light.m_ambient = Vec4f(0.1f, 0.1f, 0.1f, 1.0f);
-		light.m_diffuse = Vec4f(0.8f, 0.8f, 0.8f, 1.0f);
-		light.m_specular = Vec4f(0.5f, 0.5, 0.5, 1.0f);
-		light.m_direction = Vec3f(0.57735f, -0.57735f, 0.57735f);
-
-		Material mat;
-		mat.m_ambient = Vec4f(0.5f, 0.5f, 0.5f, 1.0f);
-		mat.m_diffuse = Vec4f(0.8f, 0.2f, 0.4f, 1.0f);
-		mat.m_specular = Vec4f(0.2f, 0.2f, 0.2f, 16.0f);
-
-		ShaderStruct::buffer.light = light;
-		ShaderStruct::buffer.mat = mat;
+		ShaderStruct::SetLighting();
 		ShaderStruct::buffer.eye_posw = m_cam.GetPosition();
 	}
 
@@ -315,7 +392,7 @@ protected:
 	{
 		m_context->SetFragmentLayout(FragmentLayout::EXTENSION0);
 		m_context->SeteDepthBuffer(m_depth_image);
-		m_context->SetIndexBuffer(m_index_buffer);
+		m_context->SetIndexBuffer(m_index_buffer, INDEX_FORMAT::R16_UINT);
 		m_context->SetVertexBuffer(m_vertex_buffer);
 
 		std::shared_ptr<Image> targets[1];
@@ -326,8 +403,7 @@ protected:
 		resource[0] = m_color_image;
 		m_context->SetShaderResources(resource, 1);
 
-		m_context->SetVertexShader(ShaderStruct::VS);
-		m_context->SetFragmentShader(ShaderStruct::PS);
+		m_context->SetPipelineState(m_pipeline_state);
 
 		m_context->Draw();
 	}
@@ -340,12 +416,49 @@ private:
 	std::shared_ptr<Image> m_depth_image;
 	std::shared_ptr<Image> m_color_image;
 
+	std::shared_ptr<PipelineState> m_pipeline_state;
+
 	Animation m_anima;
 	float m_anima_time;
 };
 
-int APIENTRY wWinMain(HINSTANCE pHinstance, HINSTANCE, LPWSTR, int pShow)
+int APIENTRY wWinMain(HINSTANCE pHinstance, HINSTANCE, LPWSTR pCmdLine, int pShow)
 {
+	//-benchmark measures fill rate without opening a window, the result is written to benchmark.txt
+	if (pCmdLine != nullptr && wcsstr(pCmdLine, L"-benchmark") != nullptr)
+	{
+		std::ofstream out("benchmark.txt");
+		FillRateBenchmark benchmark;
+		benchmark.Run(out);
+
+		//the demo shader on the same quads, one fragment per call against one packet per call
+		ShaderStruct::SetLighting();
+		ShaderStruct::buffer.world = IdentityMatrix4x4<float>();
+		ShaderStruct::buffer.view_proj = IdentityMatrix4x4<float>();
+		ShaderStruct::buffer.world_inv_trans = IdentityMatrix4x4<float>();
+		ShaderStruct::buffer.eye_posw = Vec3f(0.0f, 0.0f, -1.0f);
+
+		std::shared_ptr<Image> resource[1];
+		resource[0] = ReadPPMImage("RenderTest\\kugga.ppm");
+
+		std::shared_ptr<PipelineState> scalar_pipeline = std::make_shared<ShaderPipeline>();
+		std::shared_ptr<PipelineState> packet_pipeline = std::make_shared<PacketShaderPipeline>();
+		benchmark.RunCase(out, "demo shader", 1, [&](Context3D &pContext) {
+			ShaderStruct::context = &pContext;
+			pContext.SetShaderResources(resource, 1);
+			pContext.SetPipelineState(scalar_pipeline);
+		});
+		benchmark.RunCase(out, "demo packet shader", 1, [&](Context3D &pContext) {
+			ShaderStruct::context = &pContext;
+			pContext.SetShaderResources(resource, 1);
+			pContext.SetPipelineState(packet_pipeline);
+		});
+
+		VertexRateBenchmark vertex_benchmark;
+		vertex_benchmark.Run(out);
+		return 0;
+	}
+
 	SimpleApp app("SimpeRasterizer", pHinstance, 600, 600);
 	app.Run();
 	return 0;